@@ -11,22 +11,53 @@
 #include <memory>
 #include <random>
 #include <mutex>
+#include <map>
+#include <chrono>
 #include "utils.h"
+#include "ASMCDDContext.h"
 #include "Category.h"
+#include "PCFAccumulator.h"
+#include "Stats.h"
+
+/**
+ * Synthesis run by ASMCDD::runBatch
+ */
+struct Batch_job{
+    float domainLength = 1;
+    unsigned long seed = 0; // 0 for a random seed
+    std::string output; // Output file, its format depends on its extension (see createDiskSink)
+};
+
+struct Batch_result{
+    bool success = false; // false if the job failed with an error
+    std::string error;
+    Synthesis_status status = Synthesis_status::completed;
+    double seconds = 0;
+    std::vector<unsigned long> sizes; // Number of disks synthesized in each class
+    ASMCDD_stats stats;
+};
 
 /**
  * This class is the backbone of the algorithm
  */
 class ASMCDD{
 public:
-    explicit ASMCDD(){ categories=std::make_shared<std::vector<Category>>(); params=std::make_shared<ASMCDD_params>();};
+    explicit ASMCDD(){ categories=std::make_shared<std::vector<Category>>(); params=std::make_shared<ASMCDD_params>(); context=std::make_shared<ASMCDD_context>();};
     explicit ASMCDD(std::string const & filename);
 
     /**
-     * Loads an example file
+     * Loads an example file, either binary (see ExampleFile.h) or text
+     * \throws example_format_error if the file is malformed
      * \param filename Path to the file
      */
     void loadFile(std::string const & filename);
+
+    /**
+     * Saves the target disks in the binary example format
+     * \throws example_format_error if the file cannot be written
+     * \param filename Path to the file
+     */
+    void saveBinaryFile(std::string const & filename);
     /**
      * \deprecated Load an example file instead
      * Manually adds a class
@@ -40,6 +71,8 @@ public:
     void setParams(ASMCDD_params const & _params);
     /**
      * Computes the pcf of the target disks
+     * If a cache directory is set in the parameters, the pcfs are read from it when the example, the dependencies and the pcf
+     * parameters are unchanged, otherwise they are computed and stored in it
      */
     void computeTarget();
 
@@ -50,12 +83,93 @@ public:
      */
     void addDependency(unsigned long parent, unsigned long child);
 
+    /**
+     * Sets the sink receiving the disks as soon as they are accepted during the initialization
+     * \param sink Sink to use, nullptr to disable
+     */
+    void setSink(std::shared_ptr<DiskSink> sink);
+
     /**
      * Initialization part of the algorithm
+     * Uses initializeTiled if the tile length of the parameters is smaller than the domain
+     * Stops early if cancel is called or if the time budget of the parameters is exceeded, the disks accepted so far are kept
+     * and the sink is closed. Calling initialize again resumes an interrupted initialization (except a tiled one)
+     * \param domainLength Length of the square domain
+     * \param e_delta Error delta to add at each failed dart throw
+     * \return completed, or the reason it stopped
+     * \throws sink_io_error if the output of the sink cannot be opened
+     */
+    Synthesis_status initialize(float domainLength, float e_delta);
+
+    /**
+     * Registers an observer of the progress of the algorithm, see ASMCDDObserver
+     * \param observer Observer, its callbacks are called from a dispatcher thread
+     */
+    void addObserver(std::shared_ptr<ASMCDDObserver> observer);
+    void removeObserver(std::shared_ptr<ASMCDDObserver> const & observer);
+
+    /**
+     * Waits until the observers received every event posted so far
+     */
+    void flushObservers();
+
+    /**
+     * Stops the initialization in progress, or the next one if none is running
+     * Can be called from any thread, the initialization stops at the next dart or grid cell
+     */
+    void cancel();
+
+    /**
+     * Tiled initialization for large domains
+     * The domain is split in tiles, each synthesized on a window including a halo around the tile and conditioned on the disks
+     * already synthesized by its neighbours in that window. Tiles are processed in 4 passes so that the windows of the tiles of
+     * a pass never overlap, the tiles of a pass are synthesized in parallel. Only the disks of the tile itself are kept.
      * \param domainLength Length of the square domain
      * \param e_delta Error delta to add at each failed dart throw
+     * \param tileLength Length of the tiles, adjusted so that the tiles divide the domain
+     * \param halo Width of the halo, at most half of the tile length
+     * \return completed, or the reason it stopped, the tiles synthesized so far are then kept
+     */
+    Synthesis_status initializeTiled(float domainLength, float e_delta, float tileLength, float halo);
+
+    /**
+     * Removes the synthesized disks so that initialize can be called again, the targets are kept
+     */
+    void reset();
+
+    /**
+     * Copies the classes, their targets and dependencies, the parameters and the class ids of another instance
+     * The disks, the sink and the pretty pcfs are not copied
+     * \param other Instance to copy from, with its targets computed
+     */
+    void copyTargetFrom(ASMCDD const & other);
+
+    /**
+     * Writes the whole synthesis state (disks, pcfs, state of the class in progress and its random generator) in a file
+     * initialize calls it periodically when a checkpoint file is set in the parameters
+     * \param filename Path to the file, written atomically
+     * \return true if the checkpoint was written
+     */
+    bool saveCheckpoint(std::string const & filename);
+
+    /**
+     * Restores a checkpoint, the next call to initialize resumes the synthesis where the checkpoint was made and produces
+     * exactly the same disks as the interrupted run
+     * computeTarget must have been called, and the domain length and error delta of the parameters must be the ones of the checkpoint
+     * \throws std::runtime_error if the checkpoint cannot be read or was made with other targets or parameters
+     * \param filename Path to the file
+     */
+    void loadCheckpoint(std::string const & filename);
+
+    /**
+     * Runs several independent initializations of the current targets, computeTarget must have been called before
+     * Each worker synthesizes on its own copy of the classes, reset between its jobs
+     * \param jobs Syntheses to run, each writes its own output
+     * \param concurrency Number of jobs run at the same time
+     * \param e_delta Error delta to add at each failed dart throw
+     * \return The result of each job, in the same order
      */
-    void initialize(float domainLength, float e_delta);
+    std::vector<Batch_result> runBatch(std::vector<Batch_job> const & jobs, unsigned int concurrency, float e_delta);
 
     /**
      * Refinement part of the algorithm
@@ -96,12 +210,21 @@ public:
     std::vector<Disk> getTargetDisks(unsigned long id);
 
     /**
-     * Gets the current disks and pcf plots in a "pretty" form, not following the pcf used in computation
+     * Gets only the disks accepted after a given position, so that polling costs O(new disks)
+     * \param id Id of the class
+     * \param index Number of disks already known by the caller
+     * \param generation Generation of the disks known by the caller, 0 if none
+     * \return The new disks, with the generation and the position of the first one
+     */
+    Disks_delta getDisksSince(unsigned long id, unsigned long index, unsigned long generation);
+
+    /**
+     * Gets the current pcf plots in a "pretty" form, not following the pcf used in computation
+     * The pcfs are accumulated incrementally, only the disks accepted since the last call are evaluated
      * \param domainLength Length of the domain
-     * \param currentSizes Array in which the current sizes of the disk arrays will be written
-     * \return
+     * \return The plots of the relations that changed since the last call
      */
-    std::pair<std::vector<std::vector<Disk>>, std::vector<std::pair<std::pair<unsigned long, unsigned long>, std::vector<std::pair<float, float>>>>> getPrettyPCFplot(float domainLength, std::vector<unsigned long> const & currentSizes);
+    std::vector<std::pair<std::pair<unsigned long, unsigned long>, std::vector<std::pair<float, float>>>> getPrettyPCFplot(float domainLength);
 
     /**
      * gets the target disks and pcf plots in a "pretty" form, not following the pcf used in computation
@@ -117,9 +240,60 @@ public:
      */
     std::vector<unsigned long> getFinalSizes(float domainLength);
 
+    /**
+     * Gets the wall time of each phase, and the counters and timings of the initialization of each class
+     * Can be called while the algorithm runs, the counters are updated with each accepted disk
+     * \return
+     */
+    ASMCDD_stats getStats();
+
+    /**
+     * Waits until the algorithm changes its data (target computed, disks accepted, pcf computed)
+     * \param version Last version known by the caller, 0 at first
+     * \param timeout Maximum time to wait
+     * \return The current version, equal to version if nothing changed before the timeout
+     */
+    unsigned long waitForChange(unsigned long version, std::chrono::milliseconds timeout);
+
 private:
+    /**
+     * Creates the pretty pcf accumulators of every relation
+     * \param domainLength Length of the domain
+     */
+    void setupPrettyPCF(float domainLength);
+
+    /**
+     * Path of the cache file of the current target, keyed by a hash of the target disks, the dependencies and the pcf parameters
+     * \return
+     */
+    std::string targetCachePath();
+    uint64_t targetHash();
+
+    /**
+     * Gets the thread pool of the instance, created or replaced when its size or pinning differs from the parameters
+     * \return
+     */
+    std::shared_ptr<ThreadPool> threadPool();
+
+    void postPhase(Synthesis_event::Type type, Synthesis_phase phase, Synthesis_status status = Synthesis_status::completed);
+    bool loadTargetCache(std::string const & path);
+    void saveTargetCache(std::string const & path);
+
     std::shared_ptr<std::vector<Category>> categories;
     std::shared_ptr<ASMCDD_params> params;
+    std::shared_ptr<ASMCDD_context> context;
+    std::vector<int> class_ids; //Ids of the classes in the example file
+
+    std::map<std::pair<unsigned long, unsigned long>, PCFAccumulator> pretty_pcfs;
+    std::vector<std::pair<unsigned long, unsigned long>> pretty_cursors; //Generation and position of the disks already accumulated
+    float pretty_domainLength=0;
+    std::mutex pretty_access;
+
+    unsigned int pool_threads=0; // Number of threads the pool was created with, from the parameters
+    std::mutex pool_access;
+
+    ASMCDD_stats phase_stats; // Timings of the phases only, the stats of the classes are in the classes
+    std::mutex stats_access;
 };
 
 #endif //DISKSPROJECT_ASMCDD_H
@@ -0,0 +1,26 @@
+#ifndef DISKSPROJECT_ASMCDDCONTEXT_H
+#define DISKSPROJECT_ASMCDDCONTEXT_H
+
+#include <memory>
+#include <functional>
+#include "ChangeNotifier.h"
+#include "DiskSink.h"
+#include "CancellationToken.h"
+#include "ASMCDDObserver.h"
+#include "ThreadPool.h"
+#include "WeightCache.h"
+
+/**
+ * Runtime objects shared by an ASMCDD instance and all of its classes
+ */
+struct ASMCDD_context{
+    ChangeNotifier notifier;
+    std::shared_ptr<DiskSink> sink; // Receives the accepted disks, can be null
+    std::shared_ptr<CancellationToken> cancellation = std::make_shared<CancellationToken>(); // Polled by the initialization
+    std::shared_ptr<ObserverDispatcher> observers; // Created with the first observer, null if none
+    std::function<void(bool)> checkpoint; // Called by the classes when their state is consistent, writes a checkpoint if forced or if it is time to, can be empty
+    std::shared_ptr<ThreadPool> pool; // Runs the parallel parts, set by ASMCDD before they run and shared with its tiles and batch instances
+    std::shared_ptr<WeightCache> weights = std::make_shared<WeightCache>(); // Weights of the disks of the parents, shared by their children
+};
+
+#endif //DISKSPROJECT_ASMCDDCONTEXT_H
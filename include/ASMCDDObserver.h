@@ -0,0 +1,114 @@
+#ifndef DISKSPROJECT_ASMCDDOBSERVER_H
+#define DISKSPROJECT_ASMCDDOBSERVER_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include "EventQueue.h"
+#include "CancellationToken.h"
+
+enum class Synthesis_phase{
+    target,
+    initialization,
+    refinement
+};
+
+/**
+ * Receives the progress of the algorithm
+ * The callbacks are called one at a time by a dispatcher thread, never by the algorithm itself, so they can take their time
+ * without slowing it down (the events then wait in a queue)
+ */
+class ASMCDDObserver{
+public:
+    virtual ~ASMCDDObserver() = default;
+
+    virtual void onPhaseStarted(Synthesis_phase phase){};
+    virtual void onPhaseFinished(Synthesis_phase phase, Synthesis_status status){};
+    /**
+     * \param category Id of the class
+     * \param finalSize Number of disks the class will have
+     */
+    virtual void onCategoryStarted(unsigned long category, unsigned long finalSize){};
+    virtual void onCategoryFinished(unsigned long category, unsigned long accepted, Synthesis_status status){};
+    /**
+     * Called for batches of accepted disks, not for every disk
+     * \param category Id of the class
+     * \param accepted Number of disks of the class accepted so far
+     * \param finalSize Number of disks the class will have
+     */
+    virtual void onDisksAccepted(unsigned long category, unsigned long accepted, unsigned long finalSize){};
+    /**
+     * \param category Id of the class
+     * \param accepted Number of disks of the class accepted before the switch to the grid search
+     */
+    virtual void onGridSearchEntered(unsigned long category, unsigned long accepted){};
+    /**
+     * Called when an adaptive switch goes back to the dart throwing
+     * \param category Id of the class
+     * \param accepted Number of disks of the class accepted before the switch
+     */
+    virtual void onGridSearchLeft(unsigned long category, unsigned long accepted){};
+};
+
+struct Synthesis_event{
+    enum Type{
+        phase_started, phase_finished, category_started, category_finished, disks_accepted, grid_search_entered, grid_search_left
+    } type;
+    Synthesis_phase phase;
+    Synthesis_status status;
+    unsigned long category;
+    unsigned long accepted;
+    unsigned long finalSize;
+};
+
+/**
+ * Forwards the events posted by the algorithm to the observers from its own thread
+ * Posting only pushes in a lock-free queue, the dispatcher thread wakes up regularly and immediately for important events
+ */
+class ObserverDispatcher{
+public:
+    ObserverDispatcher();
+    /**
+     * Dispatches the remaining events and stops the thread
+     */
+    ~ObserverDispatcher();
+    ObserverDispatcher(ObserverDispatcher const &) = delete;
+    ObserverDispatcher & operator=(ObserverDispatcher const &) = delete;
+
+    void addObserver(std::shared_ptr<ASMCDDObserver> observer);
+    void removeObserver(std::shared_ptr<ASMCDDObserver> const & observer);
+
+    /**
+     * Posts an event, called by the algorithm
+     * \param event Event to post
+     * \param droppable If true the event is dropped when the queue is full, otherwise the call waits for some room
+     * \return false if the event was dropped
+     */
+    bool post(Synthesis_event const & event, bool droppable = false);
+
+    /**
+     * Waits until every event posted before the call has been dispatched
+     */
+    void flush();
+
+private:
+    void run();
+
+    static constexpr std::size_t QUEUE_CAPACITY = 4096;
+    static constexpr unsigned int WAKE_PERIOD_MS = 20; // Maximum latency of the droppable events
+
+    EventQueue<Synthesis_event> queue;
+    std::vector<std::shared_ptr<ASMCDDObserver>> observers;
+    std::mutex observers_access;
+    std::atomic<unsigned long> posted{0};
+    std::atomic<unsigned long> dispatched{0};
+    std::atomic<bool> stop{false};
+    std::mutex wake_access;
+    std::condition_variable wake;
+    std::thread thread;
+};
+
+#endif //DISKSPROJECT_ASMCDDOBSERVER_H
@@ -0,0 +1,67 @@
+#ifndef DISKSPROJECT_CANCELLATIONTOKEN_H
+#define DISKSPROJECT_CANCELLATIONTOKEN_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+/**
+ * Outcome of an initialization
+ */
+enum class Synthesis_status{
+    completed,
+    cancelled, // Stopped by a call to cancel
+    deadline_exceeded // Stopped because the time budget was exceeded
+};
+
+/**
+ * Cooperative cancellation : the algorithm polls it between two darts and between two grid cells
+ * Cancelling a token also cancels the tokens created with it as parent
+ */
+class CancellationToken{
+public:
+    explicit CancellationToken(std::shared_ptr<CancellationToken> _parent = nullptr) : parent(std::move(_parent)){};
+
+    /**
+     * Requests the cancellation, can be called from any thread
+     */
+    void cancel(){ cancelled.store(true, std::memory_order_relaxed); }
+
+    /**
+     * Sets the time after which the token is considered cancelled
+     * \param deadline Deadline, time_point::max() for none
+     */
+    void setDeadline(std::chrono::steady_clock::time_point deadline){ deadline_ticks.store(deadline.time_since_epoch().count(), std::memory_order_relaxed); }
+
+    /**
+     * Removes the cancellation request and the deadline
+     */
+    void clear(){
+        cancelled.store(false, std::memory_order_relaxed);
+        setDeadline(std::chrono::steady_clock::time_point::max());
+    }
+
+    /**
+     * \return completed if the work can go on, the reason to stop otherwise
+     */
+    Synthesis_status check() const{
+        if(cancelled.load(std::memory_order_relaxed))
+        {
+            return Synthesis_status::cancelled;
+        }
+        auto deadline = deadline_ticks.load(std::memory_order_relaxed);
+        if(deadline != std::chrono::steady_clock::time_point::max().time_since_epoch().count()
+           && std::chrono::steady_clock::now().time_since_epoch().count() >= deadline)
+        {
+            return Synthesis_status::deadline_exceeded;
+        }
+        return parent ? parent->check() : Synthesis_status::completed;
+    }
+
+private:
+    std::shared_ptr<CancellationToken> parent;
+    std::atomic<bool> cancelled{false};
+    std::atomic<std::chrono::steady_clock::rep> deadline_ticks{std::chrono::steady_clock::time_point::max().time_since_epoch().count()};
+};
+
+#endif //DISKSPROJECT_CANCELLATIONTOKEN_H
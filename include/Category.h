@@ -9,16 +9,47 @@
 #include <vector>
 #include <map>
 #include <mutex>
+#include <cstdint>
+#include <iostream>
+#include <random>
 #include "utils.h"
+#include "ASMCDDContext.h"
+#include "Stats.h"
+#include "DartSampler.h"
+
+/**
+ * State of the initialization of a class, kept between two disks so that it can be checkpointed
+ */
+struct Initialization_state{
+    std::vector<float> output_disks_radii; // Radii of the disks to place, in order
+    unsigned long n_accepted=0;
+    unsigned long fails=0;
+    bool grid_search=false; // The grid search is used once the fails threshold is exceeded, until the end unless the switch is adaptive
+    Tolerance_state tolerance;
+    double dart_seconds=0; // Adaptive switch : running average of the duration of a dart, 0 until measured
+    double grid_seconds=0; // Adaptive switch : running average of the duration of a grid search sweep, 0 until measured
+    double darts_per_accept=0; // Adaptive switch : running average of the darts thrown per accepted dart
+    Sampler_state sampler; // Importance sampling map of the darts
+    std::mt19937_64 rand_gen;
+    std::vector<std::vector<float>> weights; // Weights of the disks of the class, grown with them
+    std::map<unsigned long, std::shared_ptr<const WeightCache::Weights>> parent_weights; // Weights of the disks of the parents, shared with their other children
+    std::map<unsigned long, std::vector<float>> current_pcf;
+
+    /**
+     * Releases the memory of the state
+     */
+    void clear(){ *this = Initialization_state(); }
+};
 
 /**
  * This class is a class in the algorithm and holds the disks
  */
 class Category{
 public:
-    explicit Category(unsigned long _id, std::shared_ptr<std::vector<Category>> _categories, std::shared_ptr<ASMCDD_params> _params) : id(_id), categories(std::move(_categories)), params(std::move(_params)){initialized=false;};
+    explicit Category(unsigned long _id, std::shared_ptr<std::vector<Category>> _categories, std::shared_ptr<ASMCDD_params> _params, std::shared_ptr<ASMCDD_context> _context) : id(_id), categories(std::move(_categories)), params(std::move(_params)), context(std::move(_context)){initialized=false;};
 
     void setTargetDisks(std::vector<Disk> const & target);
+    void setTargetDisks(std::vector<Disk> && target);
     void addTargetDisk(Disk const & d);
 
     /**
@@ -26,6 +57,9 @@ public:
      * \param parent_id
      */
     void addDependency(unsigned long parent_id);
+
+    std::vector<unsigned long> const & getParents() const{ return parents_id; }
+    std::vector<unsigned long> const & getChildren() const{ return children_id; }
     void addChild(unsigned long child_id);
 
     /**
@@ -42,6 +76,15 @@ public:
     std::vector<Disk> getCurrentDisks();
     std::vector<Disk> getTargetDisks();
 
+    /**
+     * Gets the disks accepted after a given position
+     * \param index Position of the first disk to get
+     * \param generation Generation the position refers to, if outdated every disk is returned
+     * \return
+     */
+    Disks_delta getDisksSince(unsigned long index, unsigned long generation);
+    unsigned long getGeneration();
+
     /**
      * Get the compute status, which includes the disks, target rmax and the parents of the category
      * \return
@@ -56,15 +99,99 @@ public:
      */
     unsigned long getFinalSize(float domainLength);
 
-
+    /**
+     * Removes the disks and the current pcfs so that the class can be initialized again, the target is kept
+     * The allocated buffers are kept to be reused by the next initialization
+     */
     void reset();
 
+    /**
+     * Copies the target pcfs, the target disks and the relations of another class
+     * \param other Class to copy from, its id must be the same
+     */
+    void copyTargetFrom(Category const & other);
+
+    /**
+     * Updates a hash with everything the target pcfs depend on in this class (target disks, id and parents)
+     * \param hash FNV-1a hash to update
+     */
+    void hashTarget(uint64_t & hash) const;
+
+    /**
+     * Writes the target pcfs, rmax, areas and radii in a binary stream
+     * \param out Stream to write to
+     */
+    void writeTarget(std::ostream & out) const;
+
+    /**
+     * Reads target pcfs written by writeTarget, the target is left untouched if the stream is malformed
+     * \param in Stream to read from
+     * \return true if the target was read
+     */
+    bool readTarget(std::istream & in);
+
+    /**
+     * Gets the counters and timings of the last initialization, updated with each accepted disk
+     * \return
+     */
+    Category_stats getStats();
+
+    /**
+     * Adds counters and timings to those of the class (ex: of the tiles it was assembled from)
+     * \param other Stats to add
+     */
+    void addStats(Category_stats const & other);
+
+    /**
+     * Writes the synthesis state of the class in a binary stream : its disks, and either its final pcfs or the state of its
+     * initialization if it is in progress
+     * \param out Stream to write to
+     */
+    void writeState(std::ostream & out) const;
+
+    /**
+     * Reads a state written by writeState, a class in progress then resumes its initialization exactly where it was
+     * \param in Stream to read from
+     * \return false if the stream is malformed, the class is then reset
+     */
+    bool readState(std::istream & in);
+
+    /**
+     * Gives the disks of the class to the sink again at the next initialization if the class is done, for when the output of a
+     * stopped initialization is restarted
+     */
+    void replayToSink();
+
+    /**
+     * Gives the disks of the class to the sink if it is done and they were not given to it yet
+     */
+    void replayFinished();
+
+    /**
+     * Sets disks that are accepted as is at the start of the initialization, before any dart is thrown
+     * They count in the final number of disks
+     * \param fixed Fixed disks, in domain coordinates
+     */
+    void setFixedDisks(std::vector<Disk> fixed);
+    unsigned long getFixedDisksCount();
+
+    /**
+     * Functions to fill the class with disks synthesized elsewhere (ex: by tiles)
+     * startAssembly clears the disks, appendDisks adds accepted disks and finishAssembly computes the final pcfs
+     */
+    void startAssembly();
+    void appendDisks(std::vector<Disk> const & new_disks);
+    void finishAssembly(float domainLength);
+
     /**
      * Initialization part of the algorithm
+     * Stops between two disks if the cancellation token of the context is cancelled or its deadline is exceeded, the disks
+     * accepted so far are kept (without their final pcf) and calling initialize again resumes it
      * \param domainLength Domain length
-     * \param e_delta Error delta added at each dart throw fail
+     * \param e_delta Error delta, the base increment of the error tolerance at each dart throw fail (see ToleranceSchedule)
+     * \return completed, or the reason it stopped
      */
-    void initialize(float domainLength, float e_delta);
+    Synthesis_status initialize(float domainLength, float e_delta);
 
     /**
      * Refinement part of the algorithm, not implemented
@@ -75,6 +202,17 @@ public:
     void refine(unsigned long max_iter, float threshold, bool isDistanceThreshold);
     void normalize(float domainLength);
 private:
+    /**
+     * Lets the context write a checkpoint
+     * \param force Writes it even if the checkpoint period has not elapsed
+     */
+    void checkpoint(bool force);
+
+    /**
+     * Posts an event to the observers of the context, if any
+     * \return false if there are no observers or if the event was dropped
+     */
+    bool post(Synthesis_event const & event, bool droppable = false);
 
     unsigned long id;
     std::vector<unsigned long> parents_id;
@@ -83,18 +221,26 @@ private:
     std::map<unsigned long, std::vector<Target_pcf_type>> pcf;
 
     std::map<unsigned long, std::vector<Target_pcf_type>> target_pcf;
+    std::map<unsigned long, Target_pcf_arrays> target_arrays; // target_pcf split for compute_error
     std::map<unsigned long, float> target_rmax;
     std::map<unsigned long, std::vector<float>> target_areas;
     std::map<unsigned long, std::vector<float>> target_radii;
 
     std::vector<Disk> disks;
     std::vector<Disk> target_disks;
+    std::vector<Disk> fixed_disks;
 
     std::shared_ptr<std::vector<Category>> categories;
     std::shared_ptr<ASMCDD_params> params;
+    std::shared_ptr<ASMCDD_context> context;
 
     bool initialized;
+    bool in_progress=false; // The initialization was interrupted, state holds where it was
+    bool replay_sink=false; // Restored or finished disks not yet given to the sink of the current initialization
+    Initialization_state state;
+    Category_stats stats;
     unsigned long finalSize=0;
+    unsigned long generation=0;
     static std::mutex disks_access;
 
 };
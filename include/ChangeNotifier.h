@@ -0,0 +1,51 @@
+#ifndef DISKSPROJECT_CHANGENOTIFIER_H
+#define DISKSPROJECT_CHANGENOTIFIER_H
+
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+/**
+ * This class lets consumers sleep until the algorithm changes its data (new disks, new pcf...)
+ * Every change increments a version number
+ */
+class ChangeNotifier{
+public:
+    /**
+     * Signals a change to every waiting consumer
+     */
+    void notify(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            version++;
+        }
+        changed.notify_all();
+    }
+
+    /**
+     * \return The current version
+     */
+    unsigned long getVersion(){
+        std::lock_guard<std::mutex> lock(mutex);
+        return version;
+    }
+
+    /**
+     * Waits until the version differs from the given one
+     * \param last Last version known by the caller
+     * \param timeout Maximum time to wait
+     * \return The current version, equal to last if the wait timed out
+     */
+    unsigned long wait(unsigned long last, std::chrono::milliseconds timeout){
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait_for(lock, timeout, [&]{ return version != last; });
+        return version;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    unsigned long version=0;
+};
+
+#endif //DISKSPROJECT_CHANGENOTIFIER_H
@@ -0,0 +1,67 @@
+#ifndef DISKSPROJECT_DARTSAMPLER_H
+#define DISKSPROJECT_DARTSAMPLER_H
+
+#include <vector>
+#include <random>
+
+/**
+ * Weights of the cells of a DartSampler, kept by the caller so that they can be checkpointed
+ * The weight of cell i is 1 - scale*deficits[i], so that the recovery of every weight is a single update of scale
+ */
+struct Sampler_state{
+    std::vector<double> deficits;
+    double scale = 1;
+};
+
+/**
+ * Draws the positions of the darts proportionally to a coarse map of the chances of acceptance, instead of uniformly
+ * The domain is split in cells, each with a weight in [MIN_WEIGHT, 1]. A rejected dart lowers the weight of its cell, the more
+ * its error exceeded the tolerance. Since an accepted disk changes the pcfs, every weight then recovers part of the way to 1.
+ * The deficits are kept in a Fenwick tree so that a draw and a rejection cost O(log cells), and a recovery O(1)
+ */
+class DartSampler{
+public:
+    static constexpr float MIN_WEIGHT = 0.01; // Every cell can still be drawn, the map is only an estimate
+    static constexpr float REJECTION_FACTOR = 0.5; // Factor of the weight of a cell after a dart far above the tolerance
+    static constexpr float RECOVERY = 0.25; // Part of the way to 1 the weights recover after an accepted disk
+
+    /**
+     * \param _state Weights of the cells, all set to 1 if their number does not match the resolution
+     * \param _resolution Number of cells along each side of the domain
+     * \param _domainLength Length of the domain
+     */
+    DartSampler(Sampler_state & _state, unsigned long _resolution, float _domainLength);
+
+    /**
+     * Draws a position
+     * \param rand_gen Random generator
+     * \param x Set to the x coordinate, in [0, domainLength)
+     * \param y Set to the y coordinate, in [0, domainLength)
+     * \return Index of the cell of the position, to give to rejected
+     */
+    unsigned long sample(std::mt19937_64 & rand_gen, float & x, float & y);
+
+    /**
+     * Lowers the weight of a cell after a rejected dart
+     * \param cell Cell of the dart, as returned by sample
+     * \param tolerance Error tolerance of the dart
+     * \param error Error of the dart, above tolerance
+     */
+    void rejected(unsigned long cell, float tolerance, float error);
+
+    /**
+     * Lets every weight recover after a disk is accepted, by a dart or by the grid search
+     */
+    void accepted();
+
+private:
+    void build();
+
+    Sampler_state & state;
+    std::vector<double> tree; // Fenwick tree of the deficits, 1-based
+    unsigned long resolution;
+    float cell_length;
+    float domainLength;
+};
+
+#endif //DISKSPROJECT_DARTSAMPLER_H
@@ -0,0 +1,149 @@
+#ifndef DISKSPROJECT_DISKSINK_H
+#define DISKSPROJECT_DISKSINK_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include "utils.h"
+
+/**
+ * Thrown by the sinks when their output cannot be written
+ */
+class sink_io_error : public std::runtime_error
+{
+public:
+    explicit sink_io_error(std::string const & what) : std::runtime_error(what) { };
+};
+
+/**
+ * This class receives the synthesized disks as soon as they are accepted, so that they can be streamed out of the process
+ * All the functions can be called from several threads
+ */
+class DiskSink{
+public:
+    virtual ~DiskSink() = default;
+    /**
+     * Called before the initialization starts
+     * \param class_ids Ids of the classes in the example file
+     * \param domainLength Length of the domain
+     * \throws sink_io_error if the output cannot be opened
+     */
+    virtual void begin(std::vector<int> const & class_ids, float domainLength) = 0;
+    /**
+     * Called when a class starts being synthesized
+     * \param category Class id
+     * \param finalSize Number of disks that will be synthesized
+     */
+    virtual void beginCategory(unsigned long category, unsigned long finalSize){};
+    /**
+     * Called each time a disk is accepted
+     * \param category Class id
+     * \param d Disk, in domain coordinates
+     */
+    virtual void addDisk(unsigned long category, Disk const & d) = 0;
+    /**
+     * Called when a class is done
+     * \param category Class id
+     */
+    virtual void endCategory(unsigned long category){};
+    /**
+     * Called once the initialization is done, flushes everything
+     */
+    virtual void end() = 0;
+};
+
+/**
+ * Writes the disks in the text example format, normalized to a length 1 domain, so that outputs can be reused as targets
+ */
+class TextDiskSink : public DiskSink{
+public:
+    explicit TextDiskSink(std::string _filename) : filename(std::move(_filename)){};
+    void begin(std::vector<int> const & class_ids, float domainLength) override;
+    void addDisk(unsigned long category, Disk const & d) override;
+    void end() override;
+private:
+    std::string filename;
+    std::ofstream file;
+    std::vector<int> ids;
+    float scale=1;
+    std::mutex access;
+};
+
+/**
+ * Writes the disks as CSV with a "class,x,y,r" header, in domain coordinates
+ */
+class CSVDiskSink : public DiskSink{
+public:
+    explicit CSVDiskSink(std::string _filename) : filename(std::move(_filename)){};
+    void begin(std::vector<int> const & class_ids, float domainLength) override;
+    void addDisk(unsigned long category, Disk const & d) override;
+    void end() override;
+private:
+    std::string filename;
+    std::ofstream file;
+    std::vector<int> ids;
+    std::mutex access;
+};
+
+/**
+ * Writes the disks in the binary example format (see ExampleFile.h), normalized to a length 1 domain
+ * Each class gets a region of the file for its final size when it starts, its disks are written in place by batches of
+ * FLUSH_SIZE so that the memory does not grow with the classes. The counts and offsets are written once the classes are done
+ */
+class BinaryDiskSink : public DiskSink{
+public:
+    static constexpr unsigned long FLUSH_SIZE = 4096;
+
+    explicit BinaryDiskSink(std::string _filename) : filename(std::move(_filename)){};
+    void begin(std::vector<int> const & class_ids, float domainLength) override;
+    void beginCategory(unsigned long category, unsigned long finalSize) override;
+    void addDisk(unsigned long category, Disk const & d) override;
+    void endCategory(unsigned long category) override;
+    void end() override;
+private:
+    struct Class_region{
+        unsigned long offset=0; // Offset of x, y and r follow, each capacity floats long
+        unsigned long capacity=0;
+        unsigned long written=0; // Number of disks in the file
+        std::vector<float> x, y, r; // Disks not flushed yet
+    };
+
+    /**
+     * Reserves a region for a class at the end of the file, the disks already written are copied in it
+     * access must be locked
+     */
+    void reserve(Class_region & region, unsigned long capacity);
+    /**
+     * Writes the pending disks of a class in its region, access must be locked
+     */
+    void flush(Class_region & region);
+    /**
+     * Flushes a class and packs y and r after the disks it got, then records it in the table, access must be locked
+     */
+    void closeCategory(unsigned long category);
+    /**
+     * Copies floats of the file, by chunks, the destination must not be after the source if they overlap
+     */
+    void move(unsigned long from, unsigned long to, unsigned long count);
+
+    std::string filename;
+    std::fstream file;
+    std::vector<int> ids;
+    std::vector<std::pair<unsigned long, unsigned long>> table; // Count and offset of each class
+    std::map<unsigned long, Class_region> regions; // Classes in progress
+    unsigned long file_end=0; // End of the reserved regions
+    float scale=1;
+    std::mutex access;
+};
+
+/**
+ * Creates a sink from the extension of the file : .csv for CSV, .bin for binary, text otherwise
+ * \param filename Path of the output file
+ * \return The sink
+ */
+std::shared_ptr<DiskSink> createDiskSink(std::string const & filename);
+
+#endif //DISKSPROJECT_DISKSINK_H
@@ -0,0 +1,106 @@
+#ifndef DISKSPROJECT_EVENTQUEUE_H
+#define DISKSPROJECT_EVENTQUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+/**
+ * Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's algorithm)
+ * Each cell holds a sequence number telling whether it is ready to be written or read, so producers and consumers only
+ * contend on their own position counter
+ */
+template<typename T>
+class EventQueue{
+public:
+    /**
+     * \param capacity Number of cells, rounded up to a power of 2
+     */
+    explicit EventQueue(std::size_t capacity){
+        std::size_t size = 2;
+        while(size < capacity)
+        {
+            size <<= 1u;
+        }
+        mask = size-1;
+        cells.reset(new Cell[size]);
+        for(std::size_t i=0; i<size; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    EventQueue(EventQueue const &) = delete;
+    EventQueue & operator=(EventQueue const &) = delete;
+
+    /**
+     * \param value Value to push
+     * \return false if the queue is full
+     */
+    bool tryPush(T const & value){
+        std::size_t position = enqueue_position.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Cell & cell = cells[position & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)position;
+            if(diff == 0)
+            {
+                if(enqueue_position.compare_exchange_weak(position, position+1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(position+1, std::memory_order_release);
+                    return true;
+                }
+            }else if(diff < 0)
+            {
+                return false;
+            }else
+            {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * \param value Popped value
+     * \return false if the queue is empty
+     */
+    bool tryPop(T & value){
+        std::size_t position = dequeue_position.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Cell & cell = cells[position & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)(position+1);
+            if(diff == 0)
+            {
+                if(dequeue_position.compare_exchange_weak(position, position+1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(position+mask+1, std::memory_order_release);
+                    return true;
+                }
+            }else if(diff < 0)
+            {
+                return false;
+            }else
+            {
+                position = dequeue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell{
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    std::size_t mask;
+    alignas(64) std::atomic<std::size_t> enqueue_position{0};
+    alignas(64) std::atomic<std::size_t> dequeue_position{0};
+};
+
+#endif //DISKSPROJECT_EVENTQUEUE_H
@@ -0,0 +1,75 @@
+#ifndef DISKSPROJECT_EXAMPLEFILE_H
+#define DISKSPROJECT_EXAMPLEFILE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "utils.h"
+#include "ThreadPool.h"
+
+/*
+ * Binary example format, all values are stored in the native endianness :
+ * - Header : char magic[8] = "ASMCDDEX", uint32 version, uint32 number of classes
+ * - One table entry per class : int32 class id, uint32 reserved, uint64 number of disks, uint64 offset of the class data
+ * - Class data, in structure of arrays form : float x[count], float y[count], float r[count]
+ * Coordinates are stored already normalized (text coordinates divided by 10000)
+ */
+
+constexpr char BINARY_EXAMPLE_MAGIC[8] = {'A', 'S', 'M', 'C', 'D', 'D', 'E', 'X'};
+constexpr uint32_t BINARY_EXAMPLE_VERSION = 1;
+
+struct Binary_example_header{
+    char magic[8];
+    uint32_t version;
+    uint32_t n_classes;
+};
+
+struct Binary_example_entry{
+    int32_t id;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t offset;
+};
+
+/**
+ * Example disks grouped by class
+ */
+struct Example_data{
+    std::vector<int> class_ids;
+    std::vector<std::vector<Disk>> disks;
+};
+
+/**
+ * Loads a text example : the number of classes followed by the class ids, then one "id x y r" line per disk
+ * The file is read in one block and parsed in parallel chunks
+ * \throws example_format_error with the line number if the file is malformed
+ * \param filename Path to the file
+ * \param pool Pool parsing the chunks
+ * \return The disks of each class, coordinates divided by 10000
+ */
+Example_data loadTextExample(std::string const & filename, ThreadPool & pool);
+
+/**
+ * Checks if a file starts with the binary example magic
+ * \param filename Path to the file
+ * \return true if the file is a binary example
+ */
+bool isBinaryExample(std::string const & filename);
+
+/**
+ * Loads a binary example by memory mapping it
+ * \throws example_format_error if the file is not a valid binary example
+ * \param filename Path to the file
+ * \return The disks of each class
+ */
+Example_data loadBinaryExample(std::string const & filename);
+
+/**
+ * Saves disks in the binary example format
+ * \throws example_format_error if the file cannot be written
+ * \param filename Path to the file
+ * \param example Disks of each class
+ */
+void saveBinaryExample(std::string const & filename, Example_data const & example);
+
+#endif //DISKSPROJECT_EXAMPLEFILE_H
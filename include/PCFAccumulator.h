@@ -0,0 +1,59 @@
+#ifndef DISKSPROJECT_PCFACCUMULATOR_H
+#define DISKSPROJECT_PCFACCUMULATOR_H
+
+#include <vector>
+#include "utils.h"
+
+/**
+ * This class incrementally computes the "pretty" pcf between 2 sets of disks (same formula as compute_pretty_pcf)
+ * Only the pairs involving newly added disks are evaluated, so adding N_new disks costs O(N_new*N*nSteps)
+ */
+class PCFAccumulator{
+public:
+    /**
+     * \param _radii Radii to use
+     * \param _area Areas for the radii to use
+     * \param _rmax Rmax for the pcf
+     * \param _sigma Standard deviation of the gaussian kernel
+     * \param _diskfactor Disk size factor
+     * \param _same true if both sets of disks are the same (pcf of a class with itself)
+     * \param _period Length of the domain if it is periodic, 0 otherwise
+     */
+    PCFAccumulator(std::vector<float> _radii, std::vector<float> _area, float _rmax, float _sigma, float _diskfactor, bool _same, float _period=0);
+
+    /**
+     * Removes all the disks and resets the pcf
+     */
+    void reset();
+
+    /**
+     * Adds new disks to the sets and updates the pcf
+     * \param new_a New disks of set a
+     * \param new_b New disks of set b, ignored if both sets are the same
+     * \return true if the pcf changed
+     */
+    bool add(std::vector<Disk> const & new_a, std::vector<Disk> const & new_b);
+
+    /**
+     * \return The current pcf
+     */
+    std::vector<float> getPCF() const;
+
+    std::vector<float> const & getRadii() const;
+    float getRmax() const;
+
+private:
+    void addPairs(Disk const & pi, float const * weight_i, Disk const & pj, float const * weight_j);
+
+    std::vector<float> radii;
+    std::vector<float> area;
+    float rmax, sigma, diskfactor, period;
+    bool same;
+
+    std::vector<Disk> disks_a;
+    std::vector<Disk> disks_b;
+    std::vector<float> weights_a; //Clamped weights of the disks a, nSteps per disk
+    std::vector<double> sums;
+};
+
+#endif //DISKSPROJECT_PCFACCUMULATOR_H
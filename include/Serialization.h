@@ -0,0 +1,88 @@
+#ifndef DISKSPROJECT_SERIALIZATION_H
+#define DISKSPROJECT_SERIALIZATION_H
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <string>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+
+/*
+ * Light helpers to write and read plain data in binary streams, in the native endianness
+ */
+
+template<typename T>
+void writePod(std::ostream & out, T const & value){
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain data can be written");
+    out.write(reinterpret_cast<char const *>(&value), sizeof(T));
+}
+
+template<typename T>
+bool readPod(std::istream & in, T & value){
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain data can be read");
+    return bool(in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+template<typename T>
+void writeVector(std::ostream & out, std::vector<T> const & values){
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain data can be written");
+    writePod<uint64_t>(out, values.size());
+    out.write(reinterpret_cast<char const *>(values.data()), values.size()*sizeof(T));
+}
+
+template<typename T>
+bool readVector(std::istream & in, std::vector<T> & values, uint64_t max_size = uint64_t(1) << 40){
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain data can be read");
+    uint64_t size;
+    if(!readPod(in, size) || size > max_size)
+    {
+        return false;
+    }
+    values.clear();
+    //Read by blocks so that a corrupted size fails on the stream instead of allocating everything
+    constexpr uint64_t BLOCK = 1 << 12;
+    std::vector<char> buffer(BLOCK*sizeof(T));
+    for(uint64_t done = 0; done < size; done += BLOCK)
+    {
+        uint64_t n = std::min(BLOCK, size - done);
+        if(!in.read(buffer.data(), n*sizeof(T)))
+        {
+            return false;
+        }
+        auto const * first = reinterpret_cast<T const *>(buffer.data());
+        values.insert(values.end(), first, first + n);
+    }
+    return true;
+}
+
+inline void writeString(std::ostream & out, std::string const & value){
+    writeVector(out, std::vector<char>(value.begin(), value.end()));
+}
+
+inline bool readString(std::istream & in, std::string & value){
+    std::vector<char> chars;
+    if(!readVector(in, chars))
+    {
+        return false;
+    }
+    value.assign(chars.begin(), chars.end());
+    return true;
+}
+
+/**
+ * FNV-1a 64 bits hash, updated with raw bytes
+ */
+inline void hashBytes(uint64_t & hash, void const * data, unsigned long size){
+    auto const * bytes = static_cast<unsigned char const *>(data);
+    for(unsigned long i=0; i<size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+constexpr uint64_t HASH_SEED = 14695981039346656037ULL;
+
+#endif //DISKSPROJECT_SERIALIZATION_H
@@ -0,0 +1,82 @@
+#ifndef DISKSPROJECT_SPATIALDISKS_H
+#define DISKSPROJECT_SPATIALDISKS_H
+
+#include <vector>
+#include <cstdint>
+#include "utils.h"
+
+/**
+ * Working copy of a set of disks and of their weights, kept in Morton (Z) order so that the disks close in the domain are also
+ * close in memory
+ * The disks are grouped in blocks of BLOCK_SIZE with their bounding box, so that a sweep can skip the blocks out of reach of the
+ * gaussian kernel. Each disk keeps its id, its index in the original array, so that the order of the output is not affected.
+ * The added disks stay unsorted at the end until there are more than RESORT_RATIO of the sorted ones, everything is then sorted
+ */
+class SpatialDisks{
+public:
+    static constexpr unsigned long BLOCK_SIZE = 32;
+    static constexpr float RESORT_RATIO = 0.125;
+
+    struct Block{
+        float min_x, min_y, max_x, max_y;
+        float max_r;
+    };
+
+    /**
+     * \param _domainLength Length of the domain, the disks are in [0, domainLength)
+     * \param _nSteps Number of weights of each disk, 0 for none
+     */
+    SpatialDisks(float _domainLength, unsigned long _nSteps) : domainLength(_domainLength), nSteps(_nSteps){};
+
+    /**
+     * Replaces the disks
+     * \param _disks Disks, their ids are their indices
+     * \param _weights Weights of each disk, nSteps per disk, ignored if nSteps is 0
+     * \param grown true if the disks were added one by one, they are then ordered as add would have, so that a resumed
+     * initialization sums the contributions in the same order
+     */
+    void assign(std::vector<Disk> const & _disks, std::vector<std::vector<float>> const & _weights, bool grown=false);
+
+    /**
+     * Adds a disk, its id is the number of disks before it
+     * \param d Disk
+     * \param _weights Weights of the disk, nSteps of them
+     */
+    void add(Disk const & d, std::vector<float> const & _weights);
+
+    unsigned long size() const{ return disks.size(); }
+    unsigned long blockCount() const{ return blocks.size(); }
+    Disk const & disk(unsigned long slot) const{ return disks[slot]; }
+    unsigned long id(unsigned long slot) const{ return ids[slot]; }
+    float const * weights(unsigned long slot) const{ return weight_rows.data() + slot*nSteps; }
+
+    /**
+     * Tells if every disk of a block is farther than a distance from a point, plus its own radius
+     * \param b Block index, its disks are the slots [b*BLOCK_SIZE, (b+1)*BLOCK_SIZE)
+     * \param x x coordinate of the point
+     * \param y y coordinate of the point
+     * \param distance Distance between the point and the edge of the disks
+     * \param period Length of the domain if it is periodic, 0 otherwise
+     * \return
+     */
+    bool isFar(unsigned long b, float x, float y, float distance, float period) const;
+
+private:
+    /**
+     * Sorts the first count disks in Morton order, ties by id, and rebuilds the bounding boxes
+     */
+    void sort(unsigned long count);
+    void addToBlock(unsigned long slot);
+    bool needsSort(unsigned long count) const;
+    uint32_t morton(Disk const & d) const;
+
+    float domainLength;
+    unsigned long nSteps;
+    std::vector<Disk> disks;
+    std::vector<unsigned long> ids;
+    std::vector<float> weight_rows; // nSteps weights per disk, in the order of the disks
+    std::vector<Block> blocks;
+    unsigned long sorted=0; // Number of disks in Morton order, the others follow in the order they were added
+};
+
+#endif //DISKSPROJECT_SPATIALDISKS_H
@@ -0,0 +1,76 @@
+#ifndef DISKSPROJECT_STATS_H
+#define DISKSPROJECT_STATS_H
+
+#include <array>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <mutex>
+#include "ToleranceSchedule.h"
+
+/**
+ * Counters and timings of the initialization of a class
+ * Plain data so that it can be copied under a lock and written in checkpoints
+ */
+struct Category_stats{
+    static constexpr unsigned long STREAK_BUCKETS = 16;
+
+    double initialize_seconds = 0; // Wall time of the initialization of the class, without its parents
+    double grid_search_seconds = 0; // Part of initialize_seconds spent in the grid search
+    double final_pcf_seconds = 0; // Part of initialize_seconds spent in the final compute_pcf
+    unsigned long darts_thrown = 0;
+    unsigned long darts_accepted = 0;
+    unsigned long darts_rejected = 0;
+    unsigned long grid_search_entries = 0; // Number of switches to the grid search
+    unsigned long grid_search_exits = 0; // Number of switches back to the dart throwing
+    unsigned long grid_search_accepted = 0; // Disks placed by the grid search
+    unsigned long grid_search_evaluations = 0; // Positions evaluated by the grid search
+    double e_sum = 0; // Sum of the error tolerance e of every dart thrown
+    Tolerance_schedule_type tolerance_schedule = Tolerance_schedule_type::linear;
+    /**
+     * Histogram of the fail streaks, a streak ending either by an accepted dart or by the switch to the grid search
+     * Bucket 0 counts the streaks of 0 fails, bucket k>0 the streaks of [2^(k-1), 2^k) fails, the last one everything above
+     */
+    std::array<unsigned long, STREAK_BUCKETS> fail_streaks{};
+
+    void addFailStreak(unsigned long fails);
+    double averageError() const;
+    double dartsPerAccept() const;
+    Category_stats & operator+=(Category_stats const & other);
+};
+
+struct ASMCDD_stats{
+    double target_seconds = 0; // Wall time of computeTarget, including the cache
+    double initialize_seconds = 0;
+    double refine_seconds = 0;
+    std::vector<Category_stats> categories;
+};
+
+/**
+ * Adds the wall time of its scope to a total
+ */
+class ScopedTimer{
+public:
+    /**
+     * \param _total Total to add the time to
+     * \param _access Mutex to lock while adding, can be null
+     */
+    explicit ScopedTimer(double & _total, std::mutex * _access = nullptr) : total(_total), access(_access), start(std::chrono::steady_clock::now()){};
+    ~ScopedTimer();
+    ScopedTimer(ScopedTimer const &) = delete;
+    ScopedTimer & operator=(ScopedTimer const &) = delete;
+private:
+    double & total;
+    std::mutex * access;
+    std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * Writes stats in JSON
+ * \param out Stream to write to
+ * \param stats Stats to write
+ * \param indent Indentation of the object, in spaces
+ */
+void write_stats_json(std::ostream & out, ASMCDD_stats const & stats, unsigned int indent = 0);
+
+#endif //DISKSPROJECT_STATS_H
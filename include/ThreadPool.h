@@ -0,0 +1,139 @@
+#ifndef DISKSPROJECT_THREADPOOL_H
+#define DISKSPROJECT_THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <condition_variable>
+
+class ThreadPool;
+
+/**
+ * Tasks run by a ThreadPool and waited for together
+ * Groups can be nested : a task can run its own group and wait for it. A waiting thread only runs the tasks of its group, so
+ * that it is never held up by an unrelated long task
+ */
+class TaskGroup{
+public:
+    explicit TaskGroup(ThreadPool & _pool) : pool(_pool){};
+    /**
+     * Waits for the remaining tasks, their exceptions are dropped
+     */
+    ~TaskGroup();
+    TaskGroup(TaskGroup const &) = delete;
+    TaskGroup & operator=(TaskGroup const &) = delete;
+
+    /**
+     * Queues a task, it can be run by any thread of the pool
+     * \param task Task to run
+     */
+    void run(std::function<void()> task);
+
+    /**
+     * Waits until every task of the group is done, the calling thread runs tasks of the group meanwhile
+     * \throws The first exception thrown by a task of the group
+     */
+    void wait();
+
+private:
+    friend class ThreadPool;
+    void waitAll();
+
+    ThreadPool & pool;
+    std::atomic<unsigned long> pending{0}; // Tasks not done yet
+    std::atomic<unsigned long> queued{0}; // Tasks not started yet
+    std::mutex error_access;
+    std::exception_ptr error;
+};
+
+/**
+ * Work stealing thread pool shared by every parallel part of the algorithm
+ * Each worker has its own queue : it runs its newest task first and steals the oldest tasks of the others when it is empty.
+ * The thread waiting for a group takes part in it, so a pool of n threads has n-1 workers
+ */
+class ThreadPool{
+public:
+    /**
+     * \param threads Number of threads running tasks, including the waiting one, 0 for one per available core
+     * \param pin Pins each worker to one of the cores the process can run on (Linux only)
+     */
+    explicit ThreadPool(unsigned int threads = 0, bool pin = false);
+    ~ThreadPool();
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool & operator=(ThreadPool const &) = delete;
+
+    unsigned int size() const{ return n_threads; }
+    bool isPinned() const{ return pinned; }
+
+    /**
+     * Runs body on chunks of [begin, end) in parallel and waits for them
+     * \param begin First index
+     * \param end Last index, excluded
+     * \param grain Minimum number of indices of a chunk
+     * \param body Called with the bounds of each chunk, [from, to)
+     */
+    template<typename F>
+    void parallelFor(unsigned long begin, unsigned long end, unsigned long grain, F const & body);
+
+private:
+    friend class TaskGroup;
+    struct Task{
+        std::function<void()> function;
+        TaskGroup * group;
+    };
+    struct Task_queue{
+        std::mutex access;
+        std::deque<Task> tasks;
+    };
+
+    void push(Task task);
+    /**
+     * Runs a queued task, the newest of the queue of the thread first, then the oldest of the other queues
+     * \param group Only runs the tasks of this group, any task if null
+     * \return false if there was no task to run
+     */
+    bool runOne(TaskGroup * group);
+    void execute(Task & task);
+    void work(unsigned int index);
+
+    unsigned int n_threads;
+    bool pinned;
+    std::vector<std::unique_ptr<Task_queue>> queues; // Queue 0 is shared by the threads outside of the pool
+    std::vector<std::thread> workers;
+    std::atomic<unsigned long> queued{0};
+    std::atomic<bool> stop{false};
+    std::mutex sleep_access;
+    std::condition_variable wake;
+};
+
+template<typename F>
+void ThreadPool::parallelFor(unsigned long begin, unsigned long end, unsigned long grain, F const & body){
+    if(begin >= end)
+    {
+        return;
+    }
+    unsigned long n = end-begin;
+    //About 4 chunks per thread, so that stealing evens out the chunks that take longer
+    unsigned long target_chunks = 4ul*n_threads;
+    unsigned long chunk = std::max(std::max(grain, 1ul), (n+target_chunks-1)/target_chunks);
+    if(n_threads == 1 || n <= chunk)
+    {
+        body(begin, end);
+        return;
+    }
+    TaskGroup group(*this);
+    for(unsigned long from = begin+chunk; from < end; from += chunk)
+    {
+        group.run([&body, from, end, chunk](){ body(from, std::min(end, from+chunk)); });
+    }
+    body(begin, begin+chunk);
+    group.wait();
+}
+
+#endif //DISKSPROJECT_THREADPOOL_H
@@ -0,0 +1,85 @@
+#ifndef DISKSPROJECT_TOLERANCESCHEDULE_H
+#define DISKSPROJECT_TOLERANCESCHEDULE_H
+
+#include <string>
+
+/**
+ * Ways the error tolerance e of the dart throwing grows with the fails
+ * linear : e = e_delta*fails, reset to 0 on every accepted dart (the original algorithm)
+ * exponential : the increment of e is multiplied by growth after each fail, reset on every accepted dart
+ * adaptive : e = e_delta*scale*fails, scale is adapted after every accepted dart so that a dart is accepted every 1/target_acceptance darts
+ * carry_over : e grows by e_delta with each fail, and only carry*e is removed on an accepted dart
+ */
+enum class Tolerance_schedule_type{linear, exponential, adaptive, carry_over};
+
+struct Tolerance_schedule{
+    Tolerance_schedule_type type = Tolerance_schedule_type::linear;
+    float growth = 1.01; // exponential : ratio between two consecutive increments
+    float target_acceptance = 0.01; // adaptive : wanted ratio of accepted darts
+    float carry = 0.5; // carry_over : part of e kept after an accepted dart
+};
+
+/**
+ * State of a schedule, plain data so that it can be written in checkpoints
+ */
+struct Tolerance_state{
+    float e = 0; // Tolerance of the next dart
+    float increment = 0; // exponential : added to e at the next fail
+    float scale = 1; // adaptive : factor of e_delta
+};
+
+/**
+ * Gives the error tolerance of each dart thrown by the initialization of a class
+ */
+class ToleranceSchedule{
+public:
+    /**
+     * \param _schedule Schedule to follow
+     * \param _e_delta Error delta, the base increment of e
+     * \param _state State of the schedule, kept by the caller so that it can be resumed
+     */
+    ToleranceSchedule(Tolerance_schedule const & _schedule, float _e_delta, Tolerance_state & _state) : schedule(_schedule), e_delta(_e_delta), state(_state){};
+
+    /**
+     * Resets the state for a new initialization
+     */
+    void start();
+
+    /**
+     * \return Tolerance of the next dart
+     */
+    float tolerance() const{ return state.e; }
+
+    /**
+     * Called after each rejected dart
+     * \param fails Number of fails since the last accepted dart, including this one
+     */
+    void rejected(unsigned long fails);
+
+    /**
+     * Called after each accepted dart
+     * \param fails Number of fails before this dart
+     */
+    void accepted(unsigned long fails);
+
+private:
+    Tolerance_schedule schedule;
+    float e_delta;
+    Tolerance_state & state;
+};
+
+/**
+ * \param type Schedule type
+ * \return Name of the schedule type, as parsed by parse_tolerance_schedule
+ */
+const char* tolerance_schedule_name(Tolerance_schedule_type type);
+
+/**
+ * Parses a schedule type from its name : linear, exponential, adaptive or carry_over
+ * \param name Name of the schedule
+ * \param type Set to the parsed type
+ * \return false if the name is unknown
+ */
+bool parse_tolerance_schedule(std::string const & name, Tolerance_schedule_type & type);
+
+#endif //DISKSPROJECT_TOLERANCESCHEDULE_H
@@ -0,0 +1,64 @@
+#ifndef DISKSPROJECT_TRACE_H
+#define DISKSPROJECT_TRACE_H
+
+#include <string>
+#include <chrono>
+
+/*
+ * Scoped trace events exported in the Chrome Trace Event format (chrome://tracing, Perfetto)
+ * The events are only recorded when compiled with ASMCDD_TRACE defined (cmake -DASMCDD_TRACE=ON), the macros are empty otherwise
+ * Each thread records in its own buffer, so recording an event never waits for another thread
+ */
+
+#ifdef ASMCDD_TRACE
+constexpr bool TRACE_ENABLED = true;
+#else
+constexpr bool TRACE_ENABLED = false;
+#endif
+
+/**
+ * Records a complete event ("X" phase) covering its scope
+ */
+class TraceScope{
+public:
+    /**
+     * \param _name Name of the event, must outlive the trace (string literal)
+     * \param _arg Integer shown in the arguments of the event (ex: class id), negative for none
+     */
+    explicit TraceScope(char const * _name, long _arg = -1) : name(_name), arg(_arg), start(std::chrono::steady_clock::now()){};
+    ~TraceScope();
+    TraceScope(TraceScope const &) = delete;
+    TraceScope & operator=(TraceScope const &) = delete;
+private:
+    char const * name;
+    long arg;
+    std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * Names the calling thread in the trace
+ * \param name Name of the thread
+ */
+void trace_thread_name(std::string const & name);
+
+/**
+ * Writes every event recorded so far
+ * \param filename Path of the JSON file
+ * \return false if the file cannot be written
+ */
+bool trace_save(std::string const & filename);
+
+#define TRACE_CONCAT_INNER(a, b) a ## b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef ASMCDD_TRACE
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, arg) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, long(arg))
+#define TRACE_THREAD_NAME(name) trace_thread_name(name)
+#else
+#define TRACE_SCOPE(name) do{}while(false)
+#define TRACE_SCOPE_ARG(name, arg) do{}while(false)
+#define TRACE_THREAD_NAME(name) do{}while(false)
+#endif
+
+#endif //DISKSPROJECT_TRACE_H
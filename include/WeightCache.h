@@ -0,0 +1,66 @@
+#ifndef DISKSPROJECT_WEIGHTCACHE_H
+#define DISKSPROJECT_WEIGHTCACHE_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+#include "utils.h"
+#include "SpatialDisks.h"
+
+/**
+ * Perimeter weights of the disks of the parent classes, and their copies in Morton order, computed once and shared by all of their
+ * children
+ * An entry is identified by the class, the radii, the domain and the generation of the disks of the class, the entries of an older
+ * generation are dropped when a newer one is computed
+ */
+class WeightCache{
+public:
+    typedef std::vector<std::vector<float>> Weights;
+
+    /**
+     * Returns the weights of the disks of a class, computes them with get_weights if they are not known
+     * Can be called from any thread, the weights of an entry are only computed once
+     * \param category Id of the class
+     * \param generation Generation of the disks of the class
+     * \param disks Disks of the class, they must not change during the call
+     * \param radii Radii the weights are computed for
+     * \param domainLength Length of the domain
+     * \param periodic true if the domain is periodic
+     * \return
+     */
+    std::shared_ptr<const Weights> get(unsigned long category, unsigned long generation, std::vector<Disk> const & disks, std::vector<float> const & radii, float domainLength, bool periodic);
+
+    /**
+     * Same as get, returns the disks of the class in Morton order with their weights, one weight per radius
+     * \return
+     */
+    std::shared_ptr<const SpatialDisks> getSorted(unsigned long category, unsigned long generation, std::vector<Disk> const & disks, std::vector<float> const & radii, float domainLength, bool periodic);
+
+    /**
+     * Removes every entry
+     */
+    void clear();
+
+private:
+    typedef std::tuple<unsigned long, std::vector<float>, float, bool> Key;
+
+    struct Entry{
+        unsigned long generation;
+        unsigned long size;
+        std::once_flag computed, sorted_once;
+        std::shared_ptr<const Weights> weights;
+        std::shared_ptr<const SpatialDisks> sorted;
+    };
+
+    /**
+     * Finds the entry of the disks of a class and computes its weights
+     */
+    std::shared_ptr<Entry> find(unsigned long category, unsigned long generation, std::vector<Disk> const & disks, std::vector<float> const & radii, float domainLength, bool periodic);
+
+    std::mutex access;
+    std::map<Key, std::shared_ptr<Entry>> entries;
+};
+
+#endif //DISKSPROJECT_WEIGHTCACHE_H
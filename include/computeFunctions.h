@@ -6,7 +6,9 @@
 #define DISKSPROJECT_COMPUTEFUNCTIONS_H
 
 #include <vector>
+#include <random>
 #include "utils.h"
+#include "SpatialDisks.h"
 
 /*
  * These functions are at the heart of the algorithm and provide the heavy duty computation
@@ -21,28 +23,37 @@
  * \param params Parameters of the program
  * \param same_category_index Index of pi if the pcf is being computed on the same array
  * \param target_size Size of the end array of disks
+ * \param period Length of the domain if it is periodic, 0 otherwise
  * \return individual PCF of pi
  */
-std::vector<float> compute_density(Disk const & pi, std::vector<Disk> const & others, std::vector<float> const & areas, std::vector<float> const & radii, float rmax, ASMCDD_params const & params, unsigned long same_category_index, unsigned long target_size);
+std::vector<float> compute_density(Disk const & pi, std::vector<Disk> const & others, std::vector<float> const & areas, std::vector<float> const & radii, float rmax, ASMCDD_params const & params, unsigned long same_category_index, unsigned long target_size, float period=0);
+
+/**
+ * Same as compute_density, on disks in Morton order : the blocks out of reach of the kernel are skipped
+ * \param same_category_index Id of pi if the pcf is being computed on the same disks
+ */
+std::vector<float> compute_density(Disk const & pi, SpatialDisks const & others, std::vector<float> const & areas, std::vector<float> const & radii, float rmax, ASMCDD_params const & params, unsigned long same_category_index, float period=0);
 
 /**
  * Gets the weights for the given disk
  * \param d Disk of interest
  * \param radii Radii to test
  * \param diskfactor Disk size factor depending on domain length
+ * \param periodic true if the domain is periodic, all the weights are then 1
  * \return
  */
-std::vector<float> get_weight(Disk const & d, std::vector<float> const & radii, float diskfactor);
+std::vector<float> get_weight(Disk const & d, std::vector<float> const & radii, float diskfactor, bool periodic=false);
 
 /**
  * Gets the weights for the disks
  * Calls get_weight
  * \return
  */
-std::vector<std::vector<float>> get_weights(std::vector<Disk> const & disks, std::vector<float> const & radii, float diskfactor);
+std::vector<std::vector<float>> get_weights(std::vector<Disk> const & disks, std::vector<float> const & radii, float diskfactor, bool periodic=false);
 
 /**
  * Computes the partial contribution of the disk to the PCF
+ * If the domain is periodic (params.periodic), distances wrap around a domain of length 1/diskfactor and all weights are 1
  * \param pi Disk of interest
  * \param others Other disks
  * \param other_weights Weights of the other disks
@@ -55,28 +66,46 @@ std::vector<std::vector<float>> get_weights(std::vector<Disk> const & disks, std
  * \param diskfactor Disk size factor
  * \return
  */
-Contribution compute_contribution(Disk const & pi, std::vector<Disk> const & others, std::vector<std::vector<float>> other_weights, std::vector<float> const & radii, std::vector<float> const & areas, float rmax, ASMCDD_params const & params, unsigned long same_category_index, unsigned long target_size, float diskfactor);
+Contribution compute_contribution(Disk const & pi, std::vector<Disk> const & others, std::vector<std::vector<float>> const & other_weights, std::vector<float> const & radii, std::vector<float> const & areas, float rmax, ASMCDD_params const & params, unsigned long same_category_index, unsigned long target_size, float diskfactor);
+
+/**
+ * Same as compute_contribution, on disks in Morton order with their weights : the blocks out of reach of the kernel are skipped
+ * The result only differs by the order of the sums
+ * \param same_category_index Id of the disk if it's in the same disks as tested
+ */
+Contribution compute_contribution(Disk const & pi, SpatialDisks const & others, std::vector<float> const & radii, std::vector<float> const & areas, float rmax, ASMCDD_params const & params, unsigned long same_category_index, unsigned long target_size, float diskfactor);
 
 /**
  * Computes the pcf between 2 disk arrays (can be the same)
+ * With params.spatial_sort, the disks are swept in Morton order (see SpatialDisks)
  * \param disks_a Disk array a
  * \param disks_b Disk array b
  * \param area Area for the radii to use
  * \param radii Radii to use
  * \param rmax Rmax for the pcf
  * \param params Algorithm parameters
+ * \param domainLength Length of the domain the disks are in, for their Morton order
+ * \param period Length of the domain if it is periodic, 0 otherwise
  * \return
  */
-std::vector<Target_pcf_type> compute_pcf(std::vector<Disk> const & disks_a, std::vector<Disk> const & disks_b, std::vector<float> const & area, std::vector<float> const & radii, float rmax, ASMCDD_params const & params);
+std::vector<Target_pcf_type> compute_pcf(std::vector<Disk> const & disks_a, std::vector<Disk> const & disks_b, std::vector<float> const & area, std::vector<float> const & radii, float rmax, ASMCDD_params const & params, float domainLength=1, float period=0);
+
+/**
+ * Splits a target pcf in arrays and computes their reciprocals, for compute_error
+ * \param target Target pcf
+ * \return
+ */
+Target_pcf_arrays split_target_pcf(std::vector<Target_pcf_type> const & target);
 
 /**
  * Computes the error between the contribution, the current pcf and the target pcf
+ * Single pass of multiplications by the reciprocals of the target, same result as dividing by it
  * \param contribution Disk individual contribution
  * \param currentPCF Current pcf of the disk category
- * \param target Target pcf
+ * \param target Target pcf, split by split_target_pcf
  * \return
  */
-float compute_error(Contribution const & contribution, std::vector<float> const & currentPCF, std::vector<Target_pcf_type> const & target);
+float compute_error(Contribution const & contribution, std::vector<float> const & currentPCF, Target_pcf_arrays const & target);
 
 /**
  * Computes the pretty pcf between 2 sets of disks (not following the paper, for visual)
@@ -87,7 +116,19 @@ float compute_error(Contribution const & contribution, std::vector<float> const
  * \param rmax Rmax for the pcf
  * \param params Algorithm parameters
  * \param diskfactor Disk size factor
+ * \param period Length of the domain if it is periodic, 0 otherwise
  * \return
  */
-std::vector<float> compute_pretty_pcf(std::vector<Disk> const & disks_a, std::vector<Disk> const & disks_b, std::vector<float> const & radii, std::vector<float> const & area, float rmax, ASMCDD_params const & params, float diskfactor);
+std::vector<float> compute_pretty_pcf(std::vector<Disk> const & disks_a, std::vector<Disk> const & disks_b, std::vector<float> const & radii, std::vector<float> const & area, float rmax, ASMCDD_params const & params, float diskfactor, float period=0);
+
+/**
+ * Samples radii without replacement from the radii of the target disks, each repeated n_repeat times
+ * Same result as shuffling the repeated radii and keeping the first ones, but only the histogram of the distinct radii is stored
+ * \param target Target disks
+ * \param n_repeat Number of times each target radius is available
+ * \param count Number of radii to sample, at most n_repeat times the number of target disks
+ * \param rand_gen Random generator
+ * \return The sampled radii, sorted in descending order
+ */
+std::vector<float> sample_radii(std::vector<Disk> const & target, unsigned long long n_repeat, unsigned long count, std::mt19937_64 & rand_gen);
 #endif //DISKSPROJECT_COMPUTEFUNCTIONS_H
@@ -11,6 +11,9 @@
 #include <memory>
 #include <vector>
 #include <cmath>
+#include <stdexcept>
+#include <map>
+#include "ToleranceSchedule.h"
 
 /*
  * This file contains utility structures and functions that are light in nature
@@ -36,6 +39,12 @@ public:
     implementation_error() : std::logic_error("Function not yet implemented") { };
 };
 
+class example_format_error : public std::runtime_error
+{
+public:
+    explicit example_format_error(std::string const & what) : std::runtime_error(what) { };
+};
+
 struct Disk{
     Disk(float _x, float _y, float _r): x(_x), y(_y), r(_r){};
     float x, y, r;
@@ -55,12 +64,31 @@ struct Target_pcf_type{
     float radius=0;
 };
 
+/**
+ * Target pcf of a relation as a structure of arrays, with the reciprocals of its values so that compute_error is a single pass of
+ * multiplications. The reciprocals are doubles so that the products round as the divisions did, the reciprocal of 0 is infinite
+ */
+struct Target_pcf_arrays{
+    std::vector<float> mean, min, max;
+    std::vector<double> inv_mean, inv_min, inv_max;
+};
+
 struct Compute_status{
     float rmax;
     std::vector<Disk> disks;
     std::vector<unsigned long> parents;
 };
 
+/**
+ * Disks accepted since a given position in a class
+ * The generation changes every time the disks of the class are reset, in which case start is 0
+ */
+struct Disks_delta{
+    unsigned long generation;
+    unsigned long start;
+    std::vector<Disk> disks;
+};
+
 /**
  * Parameter structure of the algorithm
  * The base values are from the original paper
@@ -75,6 +103,25 @@ struct ASMCDD_params{
     float error_delta=0.0001;
     bool distanceThreshold = true;
     std::string example_filename;
+    bool periodic = false; // Synthesizes a periodic (toroidal) domain, without edge correction and tileable, the tiled initialization is then not used
+    float tile_length = 0; // Length of the tiles of the tiled initialization, 0 to synthesize the whole domain at once
+    float tile_halo = 0; // Width of the halo around each tile, 0 to use the largest pcf radius
+    float time_budget = 0; // Maximum duration of the initialization in seconds, 0 for none
+    unsigned long seed = 0; // Seed of the random generators, 0 to seed them randomly
+    std::string checkpoint_filename; // File where the initialization state is saved periodically, empty for no checkpoint
+    float checkpoint_period = 60; // Time between 2 checkpoints, in seconds
+    std::string target_cache_dir; // Directory of the target pcf cache, empty to always compute the target
+    Tolerance_schedule tolerance; // Growth of the error tolerance of the dart throwing with the fails
+    std::map<unsigned long, Tolerance_schedule> class_tolerance; // Schedules of the classes that do not use tolerance, by class id
+    unsigned long max_fails = 1000; // Fails in a row after which the dart throwing switches to the grid search, unless the switch is adaptive
+    bool adaptive_switch = false; // Switches between dart throwing and grid search on their measured costs, the output then depends on the timings
+    bool importance_sampling = false; // Draws the darts from a map of the chances of acceptance learnt from the rejections (see DartSampler)
+    float sampler_cells = 32; // Cells of the importance sampling map along a length 1 of the domain
+    bool hierarchical_grid = false; // Grid search on a coarse grid scaled to the domain and rmax, refined around its best points
+    unsigned long grid_refine_candidates = 8; // Best points refined at each level of the hierarchical grid search
+    bool spatial_sort = false; // Sweeps the disks in Morton order and skips the blocks out of reach of the kernel (see SpatialDisks)
+    unsigned int threads = 0; // Threads of the pool running the parallel parts, 0 for one per available core
+    bool pin_threads = false; // Pins each thread of the pool to a core (Linux only)
 };
 
 struct Contribution{
@@ -100,6 +147,26 @@ inline float euclidian(Disk const & a, Disk const & b)
     return std::sqrt((a.x - b.x)*(a.x - b.x) + (a.y - b.y)*(a.y - b.y));
 }
 
+/**
+ * Computes the euclidian distance between 2 disks centers in a periodic (toroidal) domain, using the minimum image
+ * \param a Disk a
+ * \param b Disk b
+ * \param period Length of the domain, 0 if the domain is not periodic
+ * \return Euclidian distance between disk centers
+ */
+inline float euclidian(Disk const & a, Disk const & b, float period)
+{
+    if(period <= 0)
+    {
+        return euclidian(a, b);
+    }
+    float dx = std::abs(a.x - b.x);
+    float dy = std::abs(a.y - b.y);
+    dx = std::min(dx, period - dx);
+    dy = std::min(dy, period - dy);
+    return std::sqrt(dx*dx + dy*dy);
+}
+
 /**
  * Gaussian kernel
  * \param sigma Standard deviation of the gaussian
@@ -124,6 +191,6 @@ inline float computeRmax(unsigned long n)
 
 float perimeter_weight(double x, double y, double r);
 float perimeter_weight(float x, float y, float r, float diskfact);
-float diskDistance(Disk const & a, Disk const & b, float rmax);
+float diskDistance(Disk const & a, Disk const & b, float rmax, float period=0);
 
 #endif //UTILS_H
@@ -6,6 +6,7 @@
 #include <chrono>
 #include <algorithm>
 #include <thread>
+#include <atomic>
 #include <fstream>
 #include <sstream>
 #include "include/Shader.h"
@@ -13,26 +14,103 @@
 #include "include/Scene.h"
 #include "include/LinePlot.h"
 #include "include/ASMCDD.h"
+#include "include/Trace.h"
 
 std::mutex draw_lock;
 
+/**
+ * Locks draw_lock, the wait shows in the trace
+ */
+void lock_draw(){
+    TRACE_SCOPE("wait draw_lock");
+    draw_lock.lock();
+}
+
 std::string const WINDOW_TITLE = "Accurate Synthesis of Multi-Class Disk Distributions - ";
 std::string const TARGET_STRING = "Computing target...";
 std::string const INIT_STRING = "Initializing : ";
-std::string TOTAL_SIZE;
-std::string CURRENT_SIZE;
 std::string const REFINE_STRING = "Refining...";
 std::string const ALGO_DONE = "Done in ";
 
 unsigned long duration;
 
-bool targetDone = false, initDone = false, refineDone = false;
-bool initDisplayed = false;
+unsigned int const MAX_FPS = 30; // Frame rate cap of the viewer
+unsigned int const PLOT_WAIT_MS = 500; // Maximum time the plotting worker sleeps without any change
+unsigned int const PLOT_MIN_PERIOD_MS = 50; // Minimum time between 2 plot updates
+bool animateLight = false; // The rotating light redraws every frame, off until toggled with l
+
+bool targetDone = false, refineDone = false;
+std::atomic<bool> initDone = false;
 ASMCDD algo;
 ASMCDD_params algo_params;
 std::vector<unsigned long> currentSizes;
+std::vector<unsigned long> currentGenerations;
 std::vector<unsigned long> finalSizes;
-unsigned long totalSize;
+
+/**
+ * Follows the progress of the initialization for the title of the window
+ */
+class ProgressObserver : public ASMCDDObserver{
+public:
+    explicit ProgressObserver(std::vector<unsigned long> estimated_sizes) : final_sizes(std::move(estimated_sizes)), accepted(final_sizes.size(), 0){}
+
+    void onCategoryStarted(unsigned long category, unsigned long finalSize) override{
+        std::lock_guard<std::mutex> lock(access);
+        final_sizes[category] = finalSize;
+    }
+
+    void onDisksAccepted(unsigned long category, unsigned long count, unsigned long finalSize) override{
+        std::lock_guard<std::mutex> lock(access);
+        accepted[category] = count;
+    }
+
+    void onCategoryFinished(unsigned long category, unsigned long count, Synthesis_status status) override{
+        std::lock_guard<std::mutex> lock(access);
+        accepted[category] = count;
+        grid_search = false;
+    }
+
+    void onGridSearchEntered(unsigned long category, unsigned long count) override{
+        std::lock_guard<std::mutex> lock(access);
+        grid_search = true;
+        grid_category = category;
+    }
+
+    void onGridSearchLeft(unsigned long category, unsigned long count) override{
+        std::lock_guard<std::mutex> lock(access);
+        grid_search = false;
+    }
+
+    /**
+     * \return Number of disks accepted and to accept, and the class being grid searched if any
+     */
+    std::string describe(){
+        std::lock_guard<std::mutex> lock(access);
+        unsigned long current = 0, total = 0;
+        for(unsigned long c = 0; c < accepted.size(); c++){
+            current += accepted[c];
+            total += final_sizes[c];
+        }
+        std::string text = std::to_string(current) + "/" + std::to_string(total);
+        if(grid_search){
+            text += " (grid search on class " + std::to_string(grid_category) + ")";
+        }
+        return text;
+    }
+
+private:
+    std::mutex access;
+    std::vector<unsigned long> final_sizes;
+    std::vector<unsigned long> accepted;
+    bool grid_search = false;
+    unsigned long grid_category = 0;
+};
+std::shared_ptr<ProgressObserver> progress;
+std::string batch_filename;
+std::string resume_filename;
+std::string stats_filename;
+std::string trace_filename;
+unsigned int batch_concurrency = 1;
 
 struct WindowHolder{
     std::shared_ptr<Program> program;
@@ -82,45 +160,96 @@ float rand_angle(){
     return uni(rand_gen);
 }
 
-void addNewInstances(std::vector<Disk> const &allDisks, unsigned long index, std::shared_ptr<Scene> const &scene,
+void addNewInstances(std::vector<Disk> const &newDisks, unsigned long start, unsigned long index, std::shared_ptr<Scene> const &scene,
                      float dlength){
-    for(unsigned long count = scene->getInstanceCount(index); count < allDisks.size(); count++){
-        Disk const &d = allDisks[count];
+    for(unsigned long count = scene->getInstanceCount(index); count < start + newDisks.size(); count++){
+        Disk const &d = newDisks[count - start];
         scene->addMeshInstance(index, {d.x / dlength, d.y / dlength, d.r / dlength, rand_angle()});
     }
 }
 
 /**
- * Updates the disks and plots;
+ * Plot data produced by the plotting worker, ready to be uploaded by the render thread
  */
+struct PlotBuffer{
+    std::vector<std::pair<std::pair<unsigned long, unsigned long>, std::vector<std::pair<float, float>>>> plots;
+    std::vector<Disks_delta> deltas;
+    bool ready = false;
+};
 
-void update(){
-    unsigned long current_size = 0;
-    bool localinit = initDone;
-    if(!localinit || !initDisplayed){
-        auto plots = algo.getPrettyPCFplot(algo_params.domainLength, currentSizes);
-        for(auto const &p : plots.second){
-            if(currentSizes[p.first.first] == finalSizes[p.first.first] &&
-               currentSizes[p.first.second] == finalSizes[p.first.second]){
-                continue;
-            }
-            draw_lock.lock();
-            windows[PCF_CURRENT].plot->replacePoints(windows[PCF_CURRENT].plot->getIdFromRelation(p.first), p.second);
-            draw_lock.unlock();
+PlotBuffer plotBuffer; // Front buffer, swapped with the worker's back buffer under plot_buffer_lock
+std::mutex plot_buffer_lock;
+
+std::atomic<bool> redisplayNeeded = true;
+
+/**
+ * Computes the plots and fetches the new disks in the background, away from the render thread
+ * Sleeps until the algorithm signals a change and stops once the final state of the initialization has been published
+ */
+void plot_worker(){
+    TRACE_THREAD_NAME("plot worker");
+    PlotBuffer back;
+    bool done;
+    unsigned long version = 0;
+    do{
+        done = initDone;
+        unsigned long new_version = algo.waitForChange(version, std::chrono::milliseconds(PLOT_WAIT_MS));
+        if(new_version == version && !done){
+            continue;
         }
-        for(unsigned long id = 0; id < plots.first.size(); id++){
-            current_size += plots.first[id].size();
-            if(currentSizes[id] == finalSizes[id]){ continue; }
-            draw_lock.lock();
-            addNewInstances(plots.first[id], id, windows[DISKS_CURRENT].scene, algo_params.domainLength);
-            currentSizes[id] = plots.first[id].size();
-            draw_lock.unlock();
+        version = new_version;
+        TRACE_SCOPE("plot");
+        back.plots = algo.getPrettyPCFplot(algo_params.domainLength);
+        back.deltas.clear();
+        for(unsigned long id = 0; id < currentSizes.size(); id++){
+            back.deltas.push_back(algo.getDisksSince(id, currentSizes[id], currentGenerations[id]));
+            currentSizes[id] = back.deltas.back().start + back.deltas.back().disks.size();
+            currentGenerations[id] = back.deltas.back().generation;
         }
-        if(localinit){
-            initDisplayed = true;
+
+        plot_buffer_lock.lock();
+        if(plotBuffer.ready){
+            //The render thread did not consume the previous result yet, append to it
+            plotBuffer.plots.insert(plotBuffer.plots.end(), back.plots.begin(), back.plots.end());
+            for(unsigned long id = 0; id < back.deltas.size(); id++){
+                auto &front_disks = plotBuffer.deltas[id].disks;
+                front_disks.insert(front_disks.end(), back.deltas[id].disks.begin(), back.deltas[id].disks.end());
+            }
+        }else{
+            std::swap(plotBuffer, back);
+            plotBuffer.ready = true;
+        }
+        plot_buffer_lock.unlock();
+        redisplayNeeded = true;
+
+        if(!done){
+            //Let the accepted disks pile up a bit instead of replotting for each of them
+            std::this_thread::sleep_for(std::chrono::milliseconds(PLOT_MIN_PERIOD_MS));
         }
-        CURRENT_SIZE = std::to_string(current_size);
+    }while(!done);
+}
+
+/**
+ * Uploads the disks and plots produced by the plotting worker;
+ */
+void update(){
+    TRACE_SCOPE("update");
+    static PlotBuffer front;
+    plot_buffer_lock.lock();
+    std::swap(plotBuffer, front);
+    plot_buffer_lock.unlock();
+    if(!front.ready){
+        return;
+    }
+    lock_draw();
+    for(auto const &p : front.plots){
+        windows[PCF_CURRENT].plot->replacePoints(windows[PCF_CURRENT].plot->getIdFromRelation(p.first), p.second);
     }
+    for(unsigned long id = 0; id < front.deltas.size(); id++){
+        addNewInstances(front.deltas[id].disks, front.deltas[id].start, id, windows[DISKS_CURRENT].scene, algo_params.domainLength);
+    }
+    draw_lock.unlock();
+    front.ready = false;
 }
 
 void anim(){
@@ -129,20 +258,27 @@ void anim(){
     lightpos[0] = 10 * std::cos(anim);
     lightpos[1] = 0;
     lightpos[2] = 10 * std::sin(anim);
-    glutPostRedisplay();
 }
 
 std::chrono::time_point start = std::chrono::high_resolution_clock::now();
-unsigned long long int nbOfFrames = 0;
 
+/**
+ * Runs at a capped frame rate, redraws only if the light moved or new data was uploaded
+ */
 void timer(int value){
-    if(nbOfFrames % 10 == 0){
-        update();
+    static bool named = false;
+    if(!named){
+        TRACE_THREAD_NAME("render");
+        named = true;
+    }
+    update();
+    {
+        static std::string last_status;
         std::string status;
         if(!targetDone){
             status = TARGET_STRING;
         }else if(!initDone){
-            status = INIT_STRING + CURRENT_SIZE + "/" + TOTAL_SIZE;
+            status = INIT_STRING + progress->describe();
         }else if(!refineDone){
             status = REFINE_STRING;
         }else{
@@ -150,11 +286,20 @@ void timer(int value){
             std::sprintf(seconds, "%.2lf", double(duration) / 1000.0);
             status = ALGO_DONE + seconds + "s";
         }
-        glutSetWindowTitle((WINDOW_TITLE + status).c_str());
+        if(status != last_status){
+            glutSetWindowTitle((WINDOW_TITLE + status).c_str());
+            last_status = status;
+        }
     }
 
-    anim();
-    glutTimerFunc(1, timer, 0);
+    if(animateLight){
+        anim();
+        redisplayNeeded = true;
+    }
+    if(redisplayNeeded.exchange(false)){
+        glutPostRedisplay();
+    }
+    glutTimerFunc(1000 / MAX_FPS, timer, 0);
 }
 
 void display_disks(WindowIndex id){
@@ -215,8 +360,9 @@ void display_window(){
     TEST_OPENGL_ERROR();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     TEST_OPENGL_ERROR();
+    TRACE_SCOPE("display");
     display_3D();
-    draw_lock.lock();
+    lock_draw();
     display_pcf(PCF_ORIGINAL);
     display_disks(DISKS_ORIGINAL);
     display_pcf(PCF_CURRENT);
@@ -231,7 +377,7 @@ void reshape_window(int width, int height){
         glutReshapeWindow(height, height);
         return;
     }
-    draw_lock.lock();
+    lock_draw();
     window_resize_3D(std::min(width / 2, width - height / 2), height);
     windows[DISKS_CURRENT].width = windows[DISKS_CURRENT].height = windows[DISKS_ORIGINAL].width = windows[DISKS_ORIGINAL].height =
             height / 2;
@@ -250,6 +396,16 @@ void reshape_window(int width, int height){
     draw_lock.unlock();
 }
 
+void keyboard(unsigned char key, int x, int y){
+    if(key == 'l'){
+        //Toggles the rotating light, the viewer then only redraws when the data changes
+        animateLight = !animateLight;
+    }else if(key == 'c'){
+        //Stops the initialization, keeping the disks accepted so far
+        algo.cancel();
+    }
+}
+
 void init_glut(int &argc, char *argv[]){
     glutInit(&argc, argv);
     glutSetOption(GLUT_RENDERING_CONTEXT, GLUT_USE_CURRENT_CONTEXT);
@@ -270,6 +426,7 @@ void init_windows(){
 
     glutDisplayFunc(display_window);
     glutReshapeFunc(reshape_window);
+    glutKeyboardFunc(keyboard);
 }
 
 bool init_glew(){
@@ -366,7 +523,13 @@ void parse_example(std::string const &fileName){
     std::string path;
     unsigned int r, g, b, id_a, id_b, count;
     std::getline(file, path); //File with example
-    algo.loadFile(path);
+    algo.setParams(algo_params); //The text examples are parsed by the thread pool of the parameters
+    try{
+        algo.loadFile(path);
+    }catch(example_format_error const &e){
+        std::cerr << e.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
     std::getline(file, path);
     count = std::stoi(path); // Number of classes
     char text[32] = "";
@@ -414,8 +577,9 @@ void parse_example(std::string const &fileName){
 
     finalSizes = algo.getFinalSizes(algo_params.domainLength);
     currentSizes.resize(finalSizes.size(), 0);
-    totalSize = std::accumulate(finalSizes.begin(), finalSizes.end(), 0UL);
-    TOTAL_SIZE = std::to_string(totalSize);
+    currentGenerations.resize(finalSizes.size(), 0);
+    progress = std::make_shared<ProgressObserver>(finalSizes);
+    algo.addObserver(progress);
     algo.setParams(algo_params);
 }
 
@@ -433,10 +597,86 @@ void setup_pcf_view(){
     windows[PCF_ORIGINAL].plot->setBounds(algo_params.step, 0, algo_params.limit, 2);
 }
 
+std::string output_filename;
+
+/**
+ * Extracts the "--option value" arguments and removes them from argv, the remaining ones are positional
+ */
+void extract_options(int &argc, char **argv){
+    int kept = 1;
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if(arg == "--output" && i + 1 < argc){
+            output_filename = argv[++i];
+        }else if(arg == "--periodic"){
+            algo_params.periodic = true;
+        }else if(arg == "--cache" && i + 1 < argc){
+            algo_params.target_cache_dir = argv[++i];
+        }else if(arg == "--trace" && i + 1 < argc){
+            trace_filename = argv[++i];
+            if(!TRACE_ENABLED){
+                std::cerr << "Built without ASMCDD_TRACE, the trace will be empty" << std::endl;
+            }
+        }else if(arg == "--stats" && i + 1 < argc){
+            stats_filename = argv[++i];
+        }else if(arg == "--time-budget" && i + 1 < argc){
+            algo_params.time_budget = std::stof(argv[++i]);
+        }else if(arg == "--seed" && i + 1 < argc){
+            algo_params.seed = std::stoul(argv[++i]);
+        }else if(arg == "--checkpoint" && i + 1 < argc){
+            algo_params.checkpoint_filename = argv[++i];
+        }else if(arg == "--checkpoint-period" && i + 1 < argc){
+            algo_params.checkpoint_period = std::stof(argv[++i]);
+        }else if(arg == "--resume" && i + 1 < argc){
+            resume_filename = argv[++i];
+        }else if(arg == "--batch" && i + 1 < argc){
+            batch_filename = argv[++i];
+        }else if(arg == "--jobs" && i + 1 < argc){
+            batch_concurrency = std::max(1, std::stoi(argv[++i]));
+        }else if(arg == "--max-fails" && i + 1 < argc){
+            algo_params.max_fails = std::stoul(argv[++i]);
+        }else if(arg == "--adaptive-switch"){
+            algo_params.adaptive_switch = true;
+        }else if(arg == "--importance-sampling"){
+            algo_params.importance_sampling = true;
+        }else if(arg == "--sampler-cells" && i + 1 < argc){
+            algo_params.sampler_cells = std::stof(argv[++i]);
+        }else if(arg == "--hierarchical-grid"){
+            algo_params.hierarchical_grid = true;
+        }else if(arg == "--refine-candidates" && i + 1 < argc){
+            algo_params.grid_refine_candidates = std::stoul(argv[++i]);
+        }else if(arg == "--spatial-sort"){
+            algo_params.spatial_sort = true;
+        }else if(arg == "--threads" && i + 1 < argc){
+            algo_params.threads = std::stoul(argv[++i]);
+        }else if(arg == "--pin-threads"){
+            algo_params.pin_threads = true;
+        }else if(arg == "--tolerance" && i + 1 < argc){
+            if(!parse_tolerance_schedule(argv[++i], algo_params.tolerance.type)){
+                std::cerr << "Unknown tolerance schedule " << argv[i] << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+        }else if(arg == "--class-tolerance" && i + 1 < argc){
+            //class_id=schedule
+            std::string value = argv[++i];
+            auto separator = value.find('=');
+            Tolerance_schedule schedule = algo_params.tolerance;
+            if(separator == std::string::npos || !parse_tolerance_schedule(value.substr(separator + 1), schedule.type)){
+                std::cerr << "Expected class_id=schedule, got " << value << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+            algo_params.class_tolerance[std::stoul(value.substr(0, separator))] = schedule;
+        }else{
+            argv[kept++] = argv[i];
+        }
+    }
+    argc = kept;
+}
+
 void parse_arguments(int argc, char **argv){
     if(argc < 2){
         std::cerr << "Usage : " << argv[0]
-                  << " example_config_file [domain_length [error_delta [sigma [step [limit [max_iter [threshold isDistance] ]]]]]]"
+                  << " [--output file] [--periodic] [--cache dir] [--stats file] [--trace file] [--time-budget s] [--seed n] [--checkpoint file [--checkpoint-period s]] [--resume file] [--batch jobs_file [--jobs n]] [--tolerance schedule] [--class-tolerance id=schedule] [--max-fails n] [--adaptive-switch] [--importance-sampling [--sampler-cells n]] [--hierarchical-grid [--refine-candidates k]] [--spatial-sort] [--threads n] [--pin-threads] example_config_file [domain_length [error_delta [sigma [step [limit [max_iter [threshold isDistance] ]]]]]]"
                   << std::endl;
         std::exit(EXIT_FAILURE);
     }else{
@@ -468,8 +708,147 @@ void parse_arguments(int argc, char **argv){
     }
 }
 
+/**
+ * Converts a text example to the binary example format, without opening any window
+ */
+int convert_example(std::string const &input, std::string const &output){
+    try{
+        ASMCDD converter;
+        converter.loadFile(input);
+        converter.saveBinaryFile(output);
+    }catch(example_format_error const &e){
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Converted " << input << " to " << output << std::endl;
+    return EXIT_SUCCESS;
+}
+
+char const * status_name(Synthesis_status status){
+    switch(status){
+        case Synthesis_status::completed:
+            return "completed";
+        case Synthesis_status::cancelled:
+            return "cancelled";
+        case Synthesis_status::deadline_exceeded:
+            return "out of time";
+    }
+    return "";
+}
+
+void save_trace(){
+    if(!trace_filename.empty() && !trace_save(trace_filename)){
+        std::cerr << "Could not write the trace " << trace_filename << std::endl;
+    }
+}
+
+/**
+ * Loads the example and the dependencies of a config file, without the meshes and the plots of the viewer
+ */
+void parse_example_headless(std::string const &fileName){
+    std::ifstream file(fileName);
+    if(!file.good()){
+        throw std::runtime_error("Could not open " + fileName);
+    }
+    std::string line;
+    unsigned int id_a, id_b, count;
+    std::getline(file, line); //File with example
+    algo.setParams(algo_params); //The text examples are parsed by the thread pool of the parameters
+    algo.loadFile(line);
+    std::getline(file, line);
+    count = std::stoi(line); // Number of classes
+    for(unsigned int i = 0; i < 2 * count; i++) // Mesh and color of each class
+    {
+        std::getline(file, line);
+    }
+    std::getline(file, line);
+    count = std::stoi(line); // Number of dependecies
+    for(unsigned int i = 0; i < count; i++){
+        std::getline(file, line);
+        std::stringstream dependency(line);
+        dependency >> id_a >> id_b;
+        algo.addDependency(id_a, id_b);
+    }
+}
+
+/**
+ * Runs the jobs of a batch file without opening any window
+ * Each line of the batch file is a job : "domain_length seed output_file", empty lines and lines starting with # are ignored
+ */
+int run_batch(){
+    std::vector<Batch_job> jobs;
+    try{
+        std::ifstream file(batch_filename);
+        if(!file.good()){
+            throw std::runtime_error("Could not open " + batch_filename);
+        }
+        std::string line;
+        unsigned long line_number = 0;
+        while(std::getline(file, line)){
+            line_number++;
+            if(line.empty() || line[0] == '#'){
+                continue;
+            }
+            std::stringstream fields(line);
+            Batch_job job;
+            if(!(fields >> job.domainLength >> job.seed >> job.output)){
+                throw std::runtime_error(batch_filename + ":" + std::to_string(line_number) + " : expected \"domain_length seed output_file\"");
+            }
+            jobs.push_back(job);
+        }
+        parse_example_headless(algo_params.example_filename);
+    }catch(std::exception const &e){
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    algo.setParams(algo_params);
+    algo.computeTarget();
+    double target_seconds = algo.getStats().target_seconds;
+    std::cout << "Target computed in " << target_seconds << "s" << std::endl;
+    auto results = algo.runBatch(jobs, batch_concurrency, algo_params.error_delta);
+    if(!stats_filename.empty()){
+        std::ofstream stats(stats_filename);
+        stats << "[";
+        for(unsigned long i = 0; i < results.size(); i++){
+            results[i].stats.target_seconds = target_seconds;
+            stats << (i == 0 ? "\n  " : ",\n  ");
+            write_stats_json(stats, results[i].stats, 2);
+        }
+        stats << "\n]\n";
+    }
+    save_trace();
+    int status = EXIT_SUCCESS;
+    for(unsigned long i = 0; i < results.size(); i++){
+        auto const &r = results[i];
+        if(r.success){
+            unsigned long total = 0;
+            for(auto s : r.sizes){
+                total += s;
+            }
+            std::cout << jobs[i].output << " : " << total << " disks in " << r.seconds << "s";
+            if(r.status != Synthesis_status::completed){
+                std::cout << " (" << status_name(r.status) << ")";
+                status = EXIT_FAILURE;
+            }
+            std::cout << std::endl;
+        }else{
+            std::cerr << jobs[i].output << " : " << r.error << std::endl;
+            status = EXIT_FAILURE;
+        }
+    }
+    return status;
+}
+
 int main(int argc, char *argv[]){
+    if(argc == 4 && std::string(argv[1]) == "--convert"){
+        return convert_example(argv[2], argv[3]);
+    }
+    extract_options(argc, argv);
     parse_arguments(argc, argv);
+    TRACE_THREAD_NAME("algorithm");
+    if(!batch_filename.empty()){
+        return run_batch();
+    }
     init_glut(argc, argv);
     init_windows();
     init_GL();
@@ -487,30 +866,49 @@ int main(int argc, char *argv[]){
 
     const unsigned char *renderer = glGetString(GL_RENDERER);
     start = std::chrono::high_resolution_clock::now();
-    glutTimerFunc(1, timer, 0);
+    glutTimerFunc(1000 / MAX_FPS, timer, 0);
     std::thread renderThread(glutMainLoop);
     std::cout << "Running " << (argc > 0 ? argv[0] : "program") << " on " << renderer << std::endl;
 
     // Compute target
     algo.computeTarget();
-    draw_lock.lock();
+    if(!resume_filename.empty()){
+        try{
+            algo.loadCheckpoint(resume_filename);
+        }catch(std::runtime_error const &e){
+            std::cerr << e.what() << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    lock_draw();
     targetDone = true;
     draw_lock.unlock();
     auto plots = algo.getPrettyTargetPCFplot(1);
 
-    draw_lock.lock();
+    lock_draw();
     for(auto const &p : plots.second){
         windows[PCF_ORIGINAL].plot->addDataPoints(windows[PCF_ORIGINAL].plot->getIdFromRelation(p.first), p.second);
     }
     for(unsigned long id = 0; id < plots.first.size(); id++){
-        addNewInstances(plots.first[id], id, windows[DISKS_ORIGINAL].scene, 1);
+        addNewInstances(plots.first[id], 0, id, windows[DISKS_ORIGINAL].scene, 1);
     }
     draw_lock.unlock();
+    std::thread plotThread(plot_worker);
 
     //Initialization
-    algo.initialize(algo_params.domainLength, algo_params.error_delta);
+    if(!output_filename.empty()){
+        algo.setSink(createDiskSink(output_filename));
+    }
+    try{
+        auto status = algo.initialize(algo_params.domainLength, algo_params.error_delta);
+        if(status != Synthesis_status::completed){
+            std::cout << "Initialization " << status_name(status) << ", keeping the disks accepted so far" << std::endl;
+        }
+    }catch(sink_io_error const &e){
+        std::cerr << "Could not write the output : " << e.what() << std::endl;
+    }
 
-    draw_lock.lock();
+    lock_draw();
     initDone = true;
     draw_lock.unlock();
 
@@ -519,13 +917,21 @@ int main(int argc, char *argv[]){
 
 
     //Done !
-    draw_lock.lock();
+    lock_draw();
     auto end = std::chrono::high_resolution_clock::now();
     duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
     refineDone = true;
     draw_lock.unlock();
 
     std::cout << "Done !" << std::endl;
+    if(!stats_filename.empty()){
+        std::ofstream stats(stats_filename);
+        write_stats_json(stats, algo.getStats());
+        stats << std::endl;
+    }
+    save_trace();
+
+    plotThread.join();
 
     renderThread.join();
 }
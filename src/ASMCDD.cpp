@@ -5,16 +5,29 @@
 #include <cmath>
 #include <algorithm>
 #include <iostream>
-#include <fstream>
 #include <map>
-#include <cassert>
 #include <queue>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <cstdio>
+#include <functional>
 #include "../include/ASMCDD.h"
 #include "../include/Category.h"
 #include "../include/computeFunctions.h"
+#include "../include/ExampleFile.h"
+#include "../include/Serialization.h"
+#include "../include/Trace.h"
+
+static constexpr char TARGET_CACHE_MAGIC[8] = {'A','S','M','C','D','D','T','C'};
+static constexpr uint32_t TARGET_CACHE_VERSION = 1;
+static constexpr char CHECKPOINT_MAGIC[8] = {'A','S','M','C','D','D','C','K'};
+//Changes with every change of the layout written by writeCheckpoint and Category::writeState, including the stats of the classes
+static constexpr uint32_t CHECKPOINT_VERSION = 6;
 
 unsigned long ASMCDD::addTargetClass(std::vector<Disk> const &target){
-    categories->emplace_back(categories->size(), categories, params);
+    class_ids.push_back(categories->size());
+    categories->emplace_back(categories->size(), categories, params, context);
     categories->back().setTargetDisks(target);
     return categories->size()-1;
 }
@@ -27,15 +40,240 @@ void ASMCDD::setParams(ASMCDD_params const &_params){
     (*params.get()) = _params;
 }
 
+std::shared_ptr<ThreadPool> ASMCDD::threadPool(){
+    std::lock_guard<std::mutex> lock(pool_access);
+    auto & pool = context->pool;
+    if(!pool || pool_threads != params->threads || pool->isPinned() != params->pin_threads)
+    {
+        //Whoever still uses the previous pool keeps it alive until it is done
+        pool = std::make_shared<ThreadPool>(params->threads, params->pin_threads);
+        pool_threads = params->threads;
+    }
+    return pool;
+}
+
 void ASMCDD::addDependency(unsigned long parent, unsigned long child){
     categories->at(parent).addChild(child);
     categories->at(child).addDependency(parent);
 }
 
 void ASMCDD::computeTarget(){
-    for(auto & category : (*categories.get()))
     {
-        category.computeTarget();
+        std::lock_guard<std::mutex> lock(stats_access);
+        phase_stats.target_seconds = 0;
+    }
+    ScopedTimer timer(phase_stats.target_seconds, &stats_access);
+    TRACE_SCOPE("ASMCDD::computeTarget");
+    postPhase(Synthesis_event::phase_started, Synthesis_phase::target);
+    std::string cachePath;
+    if(!params->target_cache_dir.empty())
+    {
+        cachePath = targetCachePath();
+        if(loadTargetCache(cachePath))
+        {
+            context->notifier.notify();
+            postPhase(Synthesis_event::phase_finished, Synthesis_phase::target);
+            return;
+        }
+    }
+    //The classes only read the target disks of the others, so they are computed in parallel
+    auto & cats = *categories.get();
+    threadPool()->parallelFor(0, cats.size(), 1, [&cats](unsigned long from, unsigned long to){
+        for(unsigned long c=from; c<to; c++)
+        {
+            cats[c].computeTarget();
+        }
+    });
+    if(!cachePath.empty())
+    {
+        saveTargetCache(cachePath);
+    }
+    context->notifier.notify();
+    postPhase(Synthesis_event::phase_finished, Synthesis_phase::target);
+}
+
+void ASMCDD::postPhase(Synthesis_event::Type type, Synthesis_phase phase, Synthesis_status status){
+    if(context->observers)
+    {
+        context->observers->post({type, phase, status, 0, 0, 0});
+    }
+}
+
+void ASMCDD::addObserver(std::shared_ptr<ASMCDDObserver> observer){
+    if(!context->observers)
+    {
+        context->observers = std::make_shared<ObserverDispatcher>();
+    }
+    context->observers->addObserver(std::move(observer));
+}
+
+void ASMCDD::removeObserver(std::shared_ptr<ASMCDDObserver> const & observer){
+    if(context->observers)
+    {
+        context->observers->removeObserver(observer);
+    }
+}
+
+void ASMCDD::flushObservers(){
+    if(context->observers)
+    {
+        context->observers->flush();
+    }
+}
+
+uint64_t ASMCDD::targetHash(){
+    uint64_t hash = HASH_SEED;
+    hashBytes(hash, &TARGET_CACHE_VERSION, sizeof(TARGET_CACHE_VERSION));
+    hashBytes(hash, &params->step, sizeof(params->step));
+    hashBytes(hash, &params->sigma, sizeof(params->sigma));
+    hashBytes(hash, &params->limit, sizeof(params->limit));
+    if(params->spatial_sort)
+    {
+        //The sums of the target pcfs are in another order
+        uint8_t spatial_sort = 1;
+        hashBytes(hash, &spatial_sort, sizeof(spatial_sort));
+    }
+    uint64_t n_classes = categories->size();
+    hashBytes(hash, &n_classes, sizeof(n_classes));
+    for(auto & category : *categories.get())
+    {
+        category.hashTarget(hash);
+    }
+    return hash;
+}
+
+std::string ASMCDD::targetCachePath(){
+    auto hash = targetHash();
+    char name[32];
+    std::snprintf(name, sizeof(name), "target_%016llx.cache", (unsigned long long)hash);
+    auto const & dir = params->target_cache_dir;
+    return dir.back() == '/' ? dir + name : dir + "/" + name;
+}
+
+bool ASMCDD::loadTargetCache(std::string const & path){
+    std::ifstream file(path, std::ios::binary);
+    if(!file)
+    {
+        return false;
+    }
+    char magic[sizeof(TARGET_CACHE_MAGIC)];
+    uint32_t version;
+    uint64_t n_classes;
+    if(!file.read(magic, sizeof(magic)) || std::memcmp(magic, TARGET_CACHE_MAGIC, sizeof(magic)) != 0
+       || !readPod(file, version) || version != TARGET_CACHE_VERSION
+       || !readPod(file, n_classes) || n_classes != categories->size())
+    {
+        return false;
+    }
+    for(auto & category : *categories.get())
+    {
+        if(!category.readTarget(file))
+        {
+            //Partially read, recomputed by the caller
+            std::cerr << "Ignoring the corrupted target cache " << path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Writes a file through a temporary file renamed at the end, so that readers never see a partial file
+ * \param path Path of the file
+ * \param write Function writing the content
+ * \return true if the file was written
+ */
+static bool write_atomically(std::string const & path, std::function<void(std::ostream &)> const & write){
+    std::string tmpPath = path + ".tmp" + std::to_string(std::random_device()());
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if(!file)
+        {
+            return false;
+        }
+        write(file);
+        if(!file)
+        {
+            file.close();
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+    }
+    if(std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+void ASMCDD::saveTargetCache(std::string const & path){
+    bool written = write_atomically(path, [this](std::ostream & file){
+        file.write(TARGET_CACHE_MAGIC, sizeof(TARGET_CACHE_MAGIC));
+        writePod(file, TARGET_CACHE_VERSION);
+        writePod<uint64_t>(file, categories->size());
+        for(auto & category : *categories.get())
+        {
+            category.writeTarget(file);
+        }
+    });
+    if(!written)
+    {
+        std::cerr << "Could not write the target cache " << path << std::endl;
+    }
+}
+
+bool ASMCDD::saveCheckpoint(std::string const & filename){
+    return write_atomically(filename, [this](std::ostream & file){
+        file.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        writePod(file, CHECKPOINT_VERSION);
+        writePod<uint64_t>(file, targetHash());
+        writePod(file, params->domainLength);
+        writePod(file, params->error_delta);
+        writePod<uint8_t>(file, params->periodic);
+        writePod<uint64_t>(file, categories->size());
+        for(auto & category : *categories.get())
+        {
+            category.writeState(file);
+        }
+    });
+}
+
+void ASMCDD::loadCheckpoint(std::string const & filename){
+    std::ifstream file(filename, std::ios::binary);
+    if(!file)
+    {
+        throw std::runtime_error("Could not open the checkpoint " + filename);
+    }
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    uint32_t version;
+    uint64_t hash, n_classes;
+    float domainLength, error_delta;
+    uint8_t periodic;
+    if(!file.read(magic, sizeof(magic)) || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0
+       || !readPod(file, version) || version != CHECKPOINT_VERSION)
+    {
+        throw std::runtime_error(filename + " is not a checkpoint");
+    }
+    if(!readPod(file, hash) || !readPod(file, domainLength) || !readPod(file, error_delta) || !readPod(file, periodic) || !readPod(file, n_classes))
+    {
+        throw std::runtime_error("Truncated checkpoint " + filename);
+    }
+    if(hash != targetHash() || n_classes != categories->size())
+    {
+        throw std::runtime_error("The checkpoint " + filename + " was made with another example, other dependencies or other pcf parameters");
+    }
+    if(domainLength != params->domainLength || error_delta != params->error_delta || bool(periodic) != params->periodic)
+    {
+        throw std::runtime_error("The checkpoint " + filename + " was made with another domain length, error delta or periodicity");
+    }
+    for(auto & category : *categories.get())
+    {
+        if(!category.readState(file))
+        {
+            reset();
+            throw std::runtime_error("Corrupted checkpoint " + filename);
+        }
     }
 }
 
@@ -55,11 +293,397 @@ std::vector<Target_pcf_type> ASMCDD::getCurrentPCF(unsigned long self){
     return getCurrentPCF(self, self);
 }
 
-void ASMCDD::initialize(float domainLength, float e_delta){
-    for(auto & category : (*categories.get()))
+void ASMCDD::setSink(std::shared_ptr<DiskSink> sink){
+    context->sink = std::move(sink);
+}
+
+Synthesis_status ASMCDD::initialize(float domainLength, float e_delta){
+    postPhase(Synthesis_event::phase_started, Synthesis_phase::initialization);
+    auto & cancellation = *context->cancellation;
+    if(params->time_budget > 0)
     {
-        category.initialize(domainLength, e_delta);
+        auto budget = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(params->time_budget));
+        cancellation.setDeadline(std::chrono::steady_clock::now() + budget);
     }
+    if(params->tile_length > 0 && params->tile_length < domainLength && !params->periodic)
+    {
+        float halo = params->tile_halo;
+        if(halo <= 0)
+        {
+            //The halo covers the largest pcf radius
+            for(auto & c : *categories.get())
+            {
+                halo = std::max(halo, c.getTargetComputeStatus().rmax*params->limit);
+            }
+        }
+        if(!params->checkpoint_filename.empty())
+        {
+            std::cerr << "Checkpoints are not supported by the tiled initialization" << std::endl;
+        }
+        auto status = initializeTiled(domainLength, e_delta, params->tile_length, halo);
+        cancellation.clear();
+        postPhase(Synthesis_event::phase_finished, Synthesis_phase::initialization, status);
+        return status;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stats_access);
+        phase_stats.initialize_seconds = 0;
+    }
+    ScopedTimer timer(phase_stats.initialize_seconds, &stats_access);
+    if(!params->checkpoint_filename.empty())
+    {
+        //The classes are initialized one after the other, the one in progress calls this between two disks
+        auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(params->checkpoint_period));
+        auto next = std::chrono::steady_clock::now() + period;
+        context->checkpoint = [this, period, next](bool force) mutable {
+            auto now = std::chrono::steady_clock::now();
+            if(!force && now < next)
+            {
+                return;
+            }
+            if(!saveCheckpoint(params->checkpoint_filename))
+            {
+                std::cerr << "Could not write the checkpoint " << params->checkpoint_filename << std::endl;
+            }
+            next = std::chrono::steady_clock::now() + period;
+        };
+    }
+    if(context->sink)
+    {
+        try
+        {
+            context->sink->begin(class_ids, domainLength);
+        }catch(sink_io_error const &)
+        {
+            //Nothing was started, the next call starts from the same state
+            context->checkpoint = nullptr;
+            cancellation.clear();
+            throw;
+        }
+    }
+    auto status = Synthesis_status::completed;
+    auto & cats = *categories.get();
+    auto pool = threadPool();
+    if(context->checkpoint || pool->size() == 1)
+    {
+        //A checkpoint saves every class, so only one can be in progress
+        for(auto & category : cats)
+        {
+            status = category.initialize(domainLength, e_delta);
+            if(status != Synthesis_status::completed)
+            {
+                break;
+            }
+        }
+    }else
+    {
+        //A class is started as soon as its parents are completed, the classes independent of each other run in parallel
+        //The finished classes are replayed first, the children then only read their state when they initialize their parents
+        std::vector<std::atomic<unsigned long>> waiting(cats.size());
+        std::vector<unsigned long> roots;
+        for(unsigned long c=0; c<cats.size(); c++)
+        {
+            cats[c].replayFinished();
+            waiting[c] = cats[c].getParents().size();
+            if(waiting[c] == 0)
+            {
+                roots.push_back(c);
+            }
+        }
+        std::atomic<Synthesis_status> dag_status{Synthesis_status::completed};
+        TaskGroup group(*pool);
+        std::function<void(unsigned long)> start = [&](unsigned long c){
+            group.run([&, c](){
+                auto category_status = cats[c].initialize(domainLength, e_delta);
+                if(category_status != Synthesis_status::completed)
+                {
+                    auto expected = Synthesis_status::completed;
+                    dag_status.compare_exchange_strong(expected, category_status);
+                    return;
+                }
+                for(unsigned long child : cats[c].getChildren())
+                {
+                    if(--waiting[child] == 0 && dag_status == Synthesis_status::completed)
+                    {
+                        start(child);
+                    }
+                }
+            });
+        };
+        //The roots are found before any is started, a started class can bring the counters of its children to 0
+        for(unsigned long c : roots)
+        {
+            start(c);
+        }
+        group.wait();
+        status = dag_status;
+    }
+    if(status != Synthesis_status::completed)
+    {
+        //The next initialization opens the output again, the classes done by this one have to be written again
+        for(auto & category : cats)
+        {
+            category.replayToSink();
+        }
+    }
+    context->checkpoint = nullptr;
+    if(context->sink)
+    {
+        context->sink->end();
+    }
+    cancellation.clear();
+    postPhase(Synthesis_event::phase_finished, Synthesis_phase::initialization, status);
+    return status;
+}
+
+void ASMCDD::cancel(){
+    context->cancellation->cancel();
+}
+
+void ASMCDD::reset(){
+    for(auto & category : *categories.get())
+    {
+        category.reset();
+    }
+    context->weights->clear();
+    {
+        std::lock_guard<std::mutex> lock(stats_access);
+        phase_stats.initialize_seconds = 0;
+        phase_stats.refine_seconds = 0;
+    }
+    context->notifier.notify();
+}
+
+void ASMCDD::copyTargetFrom(ASMCDD const & other){
+    *params.get() = *other.params.get();
+    class_ids = other.class_ids;
+    {
+        //The instances share the threads
+        std::lock_guard<std::mutex> lock(pool_access);
+        context->pool = other.context->pool;
+        pool_threads = other.pool_threads;
+    }
+    auto & cats = *categories.get();
+    auto & other_cats = *other.categories.get();
+    cats.clear();
+    cats.reserve(other_cats.size());
+    for(unsigned long i=0; i<other_cats.size(); i++)
+    {
+        cats.emplace_back(i, categories, params, context);
+        cats.back().copyTargetFrom(other_cats[i]);
+    }
+}
+
+std::vector<Batch_result> ASMCDD::runBatch(std::vector<Batch_job> const & jobs, unsigned int concurrency, float e_delta){
+    std::vector<Batch_result> results(jobs.size());
+    concurrency = std::max(1u, std::min<unsigned int>(concurrency, jobs.size()));
+    std::atomic<unsigned long> next_job{0};
+    auto worker = [&](){
+        TRACE_THREAD_NAME("batch worker");
+        ASMCDD instance;
+        instance.copyTargetFrom(*this);
+        //Cancelling this instance cancels the jobs
+        instance.context->cancellation = std::make_shared<CancellationToken>(context->cancellation);
+        for(unsigned long j = next_job++; j < jobs.size(); j = next_job++)
+        {
+            auto const & job = jobs[j];
+            auto & result = results[j];
+            auto start = std::chrono::steady_clock::now();
+            TRACE_SCOPE_ARG("batch job", j);
+            try
+            {
+                instance.reset();
+                instance.params->domainLength = job.domainLength;
+                instance.params->seed = job.seed;
+                instance.params->checkpoint_filename.clear();
+                instance.setSink(job.output.empty() ? nullptr : createDiskSink(job.output));
+                result.status = instance.initialize(job.domainLength, e_delta);
+                instance.setSink(nullptr);
+                result.sizes.clear();
+                for(auto & category : *instance.categories.get())
+                {
+                    result.sizes.push_back(category.getCurrentDisks().size());
+                }
+                result.stats = instance.getStats();
+                result.success = true;
+            }catch(std::exception const & e)
+            {
+                instance.setSink(nullptr);
+                result.error = e.what();
+            }
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        }
+    };
+    std::vector<std::thread> workers;
+    for(unsigned int i=1; i<concurrency; i++)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for(auto & t : workers)
+    {
+        t.join();
+    }
+    context->cancellation->clear();
+    return results;
+}
+
+Synthesis_status ASMCDD::initializeTiled(float domainLength, float e_delta, float tileLength, float halo){
+    {
+        std::lock_guard<std::mutex> lock(stats_access);
+        phase_stats.initialize_seconds = 0;
+    }
+    ScopedTimer timer(phase_stats.initialize_seconds, &stats_access);
+    auto & cats = *categories.get();
+    auto pool = threadPool();
+    auto n_tiles = (unsigned long)std::ceil(domainLength/tileLength);
+    float tile = domainLength/n_tiles;
+    halo = std::min(halo, tile/2);
+    float window = tile + 2*halo;
+
+    //Each tile is synthesized as a regular domain
+    auto tile_params = std::make_shared<ASMCDD_params>(*params.get());
+    tile_params->tile_length = 0;
+
+    auto & sink = context->sink;
+    if(sink)
+    {
+        sink->begin(class_ids, domainLength);
+    }
+    auto & observers = context->observers;
+    for(auto & c : cats)
+    {
+        c.startAssembly();
+        if(sink)
+        {
+            sink->beginCategory(&c - cats.data(), c.getFinalSize(domainLength));
+        }
+        if(observers)
+        {
+            observers->post({Synthesis_event::category_started, Synthesis_phase::initialization, Synthesis_status::completed, (unsigned long)(&c - cats.data()), 0, c.getFinalSize(domainLength)});
+        }
+    }
+
+    //Disks of the tiles already synthesized, per class
+    std::vector<std::vector<Disk>> result(cats.size());
+    std::atomic<Synthesis_status> status{Synthesis_status::completed};
+    for(unsigned long pass=0; pass<4 && status == Synthesis_status::completed; pass++)
+    {
+        std::vector<std::pair<unsigned long, unsigned long>> tiles;
+        for(unsigned long i=pass%2; i<n_tiles; i+=2)
+        {
+            for(unsigned long j=pass/2; j<n_tiles; j+=2)
+            {
+                tiles.emplace_back(i, j);
+            }
+        }
+        std::vector<std::vector<std::vector<Disk>>> tile_results(tiles.size());
+        pool->parallelFor(0, tiles.size(), 1, [&](unsigned long from, unsigned long to){
+            for(unsigned long t=from; t<to; t++)
+            {
+                if(status != Synthesis_status::completed)
+                {
+                    continue;
+                }
+                TRACE_SCOPE_ARG("tile", t);
+                float x0 = tiles[t].first*tile - halo;
+                float y0 = tiles[t].second*tile - halo;
+                auto this_tile_params = tile_params;
+                if(tile_params->seed)
+                {
+                    //Every tile gets its own sequence
+                    this_tile_params = std::make_shared<ASMCDD_params>(*tile_params.get());
+                    this_tile_params->seed = tile_params->seed + 0x9E3779B97F4A7C15ULL*(1 + tiles[t].first + tiles[t].second*n_tiles);
+                }
+                auto tile_categories = std::make_shared<std::vector<Category>>();
+                auto tile_context = std::make_shared<ASMCDD_context>();
+                tile_context->pool = context->pool;
+                tile_context->cancellation = std::make_shared<CancellationToken>(context->cancellation);
+                tile_categories->reserve(cats.size());
+                for(unsigned long c=0; c<cats.size(); c++)
+                {
+                    tile_categories->emplace_back(c, tile_categories, this_tile_params, tile_context);
+                    auto & tile_category = tile_categories->back();
+                    tile_category.copyTargetFrom(cats[c]);
+                    //Condition the tile on the disks of its neighbours inside its window
+                    std::vector<Disk> fixed;
+                    for(auto const & d : result[c])
+                    {
+                        if(d.x >= x0 && d.x < x0+window && d.y >= y0 && d.y < y0+window)
+                        {
+                            fixed.emplace_back(d.x-x0, d.y-y0, d.r);
+                        }
+                    }
+                    tile_category.setFixedDisks(std::move(fixed));
+                }
+                auto & kept = tile_results[t];
+                kept.resize(cats.size());
+                for(unsigned long c=0; c<cats.size(); c++)
+                {
+                    auto & tile_category = (*tile_categories)[c];
+                    auto tile_status = tile_category.initialize(window, e_delta);
+                    //The stats of the class sum those of its tiles
+                    cats[c].addStats(tile_category.getStats());
+                    //Keep the new disks whose center is inside the tile
+                    auto tile_disks = tile_category.getCurrentDisks();
+                    for(unsigned long k=tile_category.getFixedDisksCount(); k<tile_disks.size(); k++)
+                    {
+                        auto const & d = tile_disks[k];
+                        if(d.x >= halo && d.x < halo+tile && d.y >= halo && d.y < halo+tile)
+                        {
+                            kept[c].emplace_back(d.x+x0, d.y+y0, d.r);
+                        }
+                    }
+                    if(tile_status != Synthesis_status::completed)
+                    {
+                        status = tile_status;
+                        break;
+                    }
+                }
+            }
+        });
+        //Merge the tiles of the pass
+        for(auto & kept : tile_results)
+        {
+            //Tiles skipped after a cancellation have no result
+            for(unsigned long c=0; c<kept.size(); c++)
+            {
+                result[c].insert(result[c].end(), kept[c].begin(), kept[c].end());
+                cats[c].appendDisks(kept[c]);
+                if(sink)
+                {
+                    for(auto const & d : kept[c])
+                    {
+                        sink->addDisk(c, d);
+                    }
+                }
+            }
+        }
+        for(unsigned long c=0; c<cats.size() && observers; c++)
+        {
+            observers->post({Synthesis_event::disks_accepted, Synthesis_phase::initialization, Synthesis_status::completed, c, result[c].size(), cats[c].getFinalSize(domainLength)}, true);
+        }
+    }
+    for(unsigned long c=0; c<cats.size(); c++)
+    {
+        if(status == Synthesis_status::completed)
+        {
+            cats[c].finishAssembly(domainLength);
+        }
+        if(sink)
+        {
+            sink->endCategory(c);
+        }
+        if(observers)
+        {
+            observers->post({Synthesis_event::category_finished, Synthesis_phase::initialization, status, c, result[c].size(), result[c].size()});
+        }
+    }
+    if(sink)
+    {
+        sink->end();
+    }
+    return status;
 }
 
 std::vector<std::pair<std::pair<unsigned long, unsigned long>, std::vector<std::pair<float, float>>>> ASMCDD::getCurrentPCFplot(){
@@ -77,37 +701,30 @@ std::vector<Disk> ASMCDD::getCurrentDisks(unsigned long id){
     return categories->at(id).getCurrentDisks();
 }
 
+Disks_delta ASMCDD::getDisksSince(unsigned long id, unsigned long index, unsigned long generation){
+    return categories->at(id).getDisksSince(index, generation);
+}
+
 void ASMCDD::loadFile(std::string const & filename){
-    int buffer;
-    std::ifstream file;
-    file.open(filename);
-    assert(file.good());
-    if(!(file >> buffer))
-    {
-        std::cout << "ERREUR" << std::endl;
-        exit(1);
-    }
-    unsigned int n_classes = buffer;
-    std::map<unsigned int, unsigned int> id_map;
+    auto example = isBinaryExample(filename) ? loadBinaryExample(filename) : loadTextExample(filename, *threadPool());
     auto cats = categories.get();
     cats->clear();
-    for(unsigned int i=0; i<n_classes; i++)
+    class_ids = example.class_ids;
+    for(unsigned int i=0; i<example.disks.size(); i++)
     {
-        file >> buffer;
-        id_map.insert_or_assign(buffer, i);
-        cats->emplace_back(i, categories, params);
+        cats->emplace_back(i, categories, params, context);
+        cats->back().setTargetDisks(std::move(example.disks[i]));
     }
-    while(file >> buffer)
+}
+
+void ASMCDD::saveBinaryFile(std::string const & filename){
+    Example_data example;
+    example.class_ids = class_ids;
+    for(auto & c : *categories.get())
     {
-        float x, y, r;
-        unsigned int index = id_map[buffer];
-        file >> x >> y >>r;
-        x/=10000.f;
-        y/=10000.f;
-        r/=10000.f;
-        (*cats)[index].addTargetDisk({x,y,r});
+        example.disks.push_back(c.getTargetDisks());
     }
-    file.close();
+    saveBinaryExample(filename, example);
 }
 
 ASMCDD::ASMCDD(std::string const &filename) : ASMCDD::ASMCDD(){
@@ -136,41 +753,18 @@ void ASMCDD::normalize(float domainLength){
     }
 }
 
-std::pair<std::vector<std::vector<Disk>>, std::vector<std::pair<std::pair<unsigned long, unsigned long>, std::vector<std::pair<float, float>>>>> ASMCDD::getPrettyPCFplot(float domainLength, std::vector<unsigned long> const &currentSizes){
-    std::pair<std::vector<std::vector<Disk>>, std::vector<std::pair<std::pair<unsigned long, unsigned long>, std::vector<std::pair<float, float>>>>> plots;
+void ASMCDD::setupPrettyPCF(float domainLength){
     float diskfactor = 1/domainLength;
-    //Get all the disks and info
-    std::vector<Compute_status> compute_stats;
-    for(auto & c : *categories.get())
-    {
-        compute_stats.push_back(c.getComputeStatus());
-    }
-    //Get the pretty pcfs from them
+    float period = params->periodic ? domainLength : 0;
+    pretty_pcfs.clear();
+    pretty_cursors.assign(categories->size(), {0, 0});
+    pretty_domainLength = domainLength;
 
     //Compute common weight terms
     auto nSteps = (unsigned long)(params->limit/params->step);
-    std::vector<std::vector<float>> radii;
-    std::vector<std::vector<float>> area;
-    radii.resize(compute_stats.size());
-    area.resize(compute_stats.size());
-    float totalRmax;
-    std::vector<float> totalRadii;
-    std::vector<float> totalArea;
-    for(unsigned long c=0; c<compute_stats.size(); c++)
-    {
-        float rmax = compute_stats[c].rmax;
-        radii[c].resize(nSteps);
-        area[c].resize(nSteps);
-        for(unsigned long k=0; k<nSteps; k++)
-        {
-            radii[c][k] = (k+1)*params->step*rmax;
-            float inner = std::max(0.f, radii[c][k]-0.5f*rmax);
-            float outer = radii[c][k]+0.5f*rmax;
-            area[c][k] = M_PI*(outer*outer - inner*inner);
-        }
-    }
+    std::vector<float> totalRadii, totalArea;
     auto finalSizes = getFinalSizes(1);
-    totalRmax = computeRmax(std::accumulate(finalSizes.begin(), finalSizes.end(), 0UL));
+    float totalRmax = computeRmax(std::accumulate(finalSizes.begin(), finalSizes.end(), 0UL));
     totalRadii.resize(nSteps);
     totalArea.resize(nSteps);
     for(unsigned long k=0; k<nSteps; k++)
@@ -181,35 +775,85 @@ std::pair<std::vector<std::vector<Disk>>, std::vector<std::pair<std::pair<unsign
         totalArea[k] = M_PI*(outer*outer - inner*inner);
     }
 
-    for(unsigned long c=0; c<compute_stats.size(); c++)
+    for(unsigned long c=0; c<categories->size(); c++)
     {
-        auto & stat = compute_stats[c];
-        std::vector<std::pair<float, float>> plot;
-        plots.first.push_back(stat.disks);
-        if(currentSizes[c] != stat.disks.size())
+        auto stat = (*categories)[c].getTargetComputeStatus();
+        std::vector<float> radii, area;
+        radii.resize(nSteps);
+        area.resize(nSteps);
+        for(unsigned long k=0; k<nSteps; k++)
         {
-            std::vector<float> pcf = compute_pretty_pcf(stat.disks, stat.disks, radii[c], area[c], stat.rmax, *params.get(), diskfactor);
-            plot.resize(pcf.size());
-            for(unsigned long k=0; k<radii[c].size(); k++)
-            {
-                plot[k].first = radii[c][k]/(stat.rmax);
-                plot[k].second = pcf[k]*domainLength*domainLength;
-            }
-            plots.second.emplace_back(std::make_pair(c, c), plot);
+            radii[k] = (k+1)*params->step*stat.rmax;
+            float inner = std::max(0.f, radii[k]-0.5f*stat.rmax);
+            float outer = radii[k]+0.5f*stat.rmax;
+            area[k] = M_PI*(outer*outer - inner*inner);
         }
+        pretty_pcfs.emplace(std::make_pair(c, c), PCFAccumulator(radii, area, stat.rmax, params->sigma, diskfactor, true, period));
         for(unsigned long other : stat.parents)
         {
-            if(currentSizes[c] != stat.disks.size() || currentSizes[other] != compute_stats[other].disks.size())
+            pretty_pcfs.emplace(std::make_pair(other, c), PCFAccumulator(totalRadii, totalArea, totalRmax, params->sigma, diskfactor, false, period));
+        }
+    }
+}
+
+std::vector<std::pair<std::pair<unsigned long, unsigned long>, std::vector<std::pair<float, float>>>> ASMCDD::getPrettyPCFplot(float domainLength){
+    std::vector<std::pair<std::pair<unsigned long, unsigned long>, std::vector<std::pair<float, float>>>> plots;
+    std::lock_guard<std::mutex> lock(pretty_access);
+    if(pretty_domainLength != domainLength || pretty_cursors.size() != categories->size())
+    {
+        setupPrettyPCF(domainLength);
+    }
+    //Get only the disks accepted since the last call
+    std::vector<Disks_delta> deltas;
+    deltas.reserve(categories->size());
+    for(unsigned long c=0; c<categories->size(); c++)
+    {
+        auto & cursor = pretty_cursors[c];
+        deltas.push_back(getDisksSince(c, cursor.second, cursor.first));
+        if(deltas.back().start != cursor.second)
+        {
+            //The disks of a class were reset, start over from scratch
+            setupPrettyPCF(domainLength);
+            deltas.clear();
+            c = -1UL;
+            continue;
+        }
+        cursor.first = deltas.back().generation;
+        cursor.second += deltas.back().disks.size();
+    }
+    //The accumulators are independent, each relation is updated by a task
+    std::vector<std::pair<std::pair<unsigned long, unsigned long> const, PCFAccumulator> *> relations;
+    for(auto & relation : pretty_pcfs)
+    {
+        relations.push_back(&relation);
+    }
+    std::vector<std::vector<std::pair<float, float>>> relation_plots(relations.size());
+    std::vector<char> changed(relations.size(), 0);
+    threadPool()->parallelFor(0, relations.size(), 1, [&](unsigned long from, unsigned long to){
+        for(unsigned long r=from; r<to; r++)
+        {
+            auto & relation = *relations[r];
+            auto & accumulator = relation.second;
+            if(accumulator.add(deltas[relation.first.second].disks, deltas[relation.first.first].disks))
             {
-                std::vector<float> pcf = compute_pretty_pcf(stat.disks, compute_stats[other].disks, totalRadii, totalArea, totalRmax, *params.get(), diskfactor);
+                auto pcf = accumulator.getPCF();
+                auto & plot = relation_plots[r];
                 plot.resize(pcf.size());
-                for(unsigned long k=0; k<radii[c].size(); k++)
+                for(unsigned long k=0; k<pcf.size(); k++)
                 {
+                    plot[k].first = accumulator.getRadii()[k]/accumulator.getRmax();
                     plot[k].second = pcf[k]*domainLength*domainLength;
                 }
-                plots.second.emplace_back(std::make_pair(other, c), plot);
+                changed[r] = 1;
             }
         }
+    });
+    for(unsigned long r=0; r<relations.size(); r++)
+    {
+        if(changed[r])
+        {
+            plots.emplace_back(relations[r]->first, std::move(relation_plots[r]));
+        }
     }
 
     return plots;
@@ -292,6 +936,30 @@ std::vector<unsigned long> ASMCDD::getFinalSizes(float domainLength){
     return sizes;
 }
 
+unsigned long ASMCDD::waitForChange(unsigned long version, std::chrono::milliseconds timeout){
+    return context->notifier.wait(version, timeout);
+}
+
 void ASMCDD::refine(unsigned long max_iter, float threshold, bool isDistanceThreshold){
+    {
+        std::lock_guard<std::mutex> lock(stats_access);
+        phase_stats.refine_seconds = 0;
+    }
+    ScopedTimer timer(phase_stats.refine_seconds, &stats_access);
+    postPhase(Synthesis_event::phase_started, Synthesis_phase::refinement);
     //TODO
+    postPhase(Synthesis_event::phase_finished, Synthesis_phase::refinement);
+}
+
+ASMCDD_stats ASMCDD::getStats(){
+    ASMCDD_stats stats;
+    {
+        std::lock_guard<std::mutex> lock(stats_access);
+        stats = phase_stats;
+    }
+    for(auto & category : *categories.get())
+    {
+        stats.categories.push_back(category.getStats());
+    }
+    return stats;
 }
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include "../include/ASMCDDObserver.h"
+#include "../include/Trace.h"
+
+ObserverDispatcher::ObserverDispatcher() : queue(QUEUE_CAPACITY){
+    thread = std::thread(&ObserverDispatcher::run, this);
+}
+
+ObserverDispatcher::~ObserverDispatcher(){
+    stop = true;
+    wake.notify_one();
+    thread.join();
+}
+
+void ObserverDispatcher::addObserver(std::shared_ptr<ASMCDDObserver> observer){
+    std::lock_guard<std::mutex> lock(observers_access);
+    observers.push_back(std::move(observer));
+}
+
+void ObserverDispatcher::removeObserver(std::shared_ptr<ASMCDDObserver> const & observer){
+    std::lock_guard<std::mutex> lock(observers_access);
+    observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+}
+
+bool ObserverDispatcher::post(Synthesis_event const & event, bool droppable){
+    while(!queue.tryPush(event))
+    {
+        if(droppable)
+        {
+            return false;
+        }
+        wake.notify_one();
+        std::this_thread::yield();
+    }
+    posted++;
+    if(!droppable)
+    {
+        //Notifying without the lock can miss a dispatcher about to sleep, it then wakes up after WAKE_PERIOD_MS
+        wake.notify_one();
+    }
+    return true;
+}
+
+void ObserverDispatcher::flush(){
+    unsigned long target = posted;
+    while(dispatched < target)
+    {
+        wake.notify_one();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void ObserverDispatcher::run(){
+    TRACE_THREAD_NAME("observers");
+    Synthesis_event event{};
+    std::vector<std::shared_ptr<ASMCDDObserver>> current;
+    for(;;)
+    {
+        bool stopping = stop;
+        {
+            std::lock_guard<std::mutex> lock(observers_access);
+            current = observers;
+        }
+        while(queue.tryPop(event))
+        {
+            for(auto & observer : current)
+            {
+                switch(event.type)
+                {
+                    case Synthesis_event::phase_started:
+                        observer->onPhaseStarted(event.phase);
+                        break;
+                    case Synthesis_event::phase_finished:
+                        observer->onPhaseFinished(event.phase, event.status);
+                        break;
+                    case Synthesis_event::category_started:
+                        observer->onCategoryStarted(event.category, event.finalSize);
+                        break;
+                    case Synthesis_event::category_finished:
+                        observer->onCategoryFinished(event.category, event.accepted, event.status);
+                        break;
+                    case Synthesis_event::disks_accepted:
+                        observer->onDisksAccepted(event.category, event.accepted, event.finalSize);
+                        break;
+                    case Synthesis_event::grid_search_entered:
+                        observer->onGridSearchEntered(event.category, event.accepted);
+                        break;
+                    case Synthesis_event::grid_search_left:
+                        observer->onGridSearchLeft(event.category, event.accepted);
+                        break;
+                }
+            }
+            dispatched++;
+        }
+        if(stopping)
+        {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(wake_access);
+        wake.wait_for(lock, std::chrono::milliseconds(WAKE_PERIOD_MS));
+    }
+}
@@ -3,15 +3,38 @@
 //
 #include <algorithm>
 #include <random>
+#include <sstream>
+#include <chrono>
+#include <atomic>
 #include "../include/Category.h"
 #include "../include/computeFunctions.h"
+#include "../include/Serialization.h"
+#include "../include/Trace.h"
 
 std::mutex Category::disks_access;
 
+constexpr unsigned long ACCEPTED_EVENT_BATCH = 64; // Maximum number of accepted disks between two progress events
+constexpr double ACCEPTED_EVENT_PERIOD = 0.02; // Maximum time between two progress events, in seconds
+constexpr double SWITCH_SMOOTHING = 0.1; // Weight of the last measure in the running averages of the adaptive switch
+constexpr double SWITCH_BACK_MARGIN = 0.5; // The adaptive switch goes back to darts when they are expected to cost less than this part of a sweep
+
+/**
+ * Point evaluated by the hierarchical grid search
+ */
+struct Grid_point{
+    Disk d;
+    float error;
+    std::map<unsigned long, Contribution> contributions;
+};
+
 void Category::setTargetDisks(std::vector<Disk> const &target){
     target_disks = target;
 }
 
+void Category::setTargetDisks(std::vector<Disk> &&target){
+    target_disks = std::move(target);
+}
+
 void Category::addDependency(unsigned long parent_id){
     if(std::find(parents_id.begin(), parents_id.end(), parent_id) == parents_id.end())
     {
@@ -27,9 +50,12 @@ void Category::addChild(unsigned long child_id){
 }
 
 void Category::computeTarget(){
+    TRACE_SCOPE_ARG("Category::computeTarget", id);
     target_pcf.clear();
+    target_arrays.clear();
     target_rmax.clear();
     target_radii.clear();
+    target_areas.clear();
 
     if(target_disks.empty())
     {
@@ -62,57 +88,54 @@ void Category::computeTarget(){
         }
         target_areas.insert(std::make_pair(parent, area));
         target_radii.insert(std::make_pair(parent, radii));
+    }
 
-        auto & parent_disks = (*categories.get())[parent].target_disks;
-        target_pcf.insert(std::make_pair(parent, compute_pcf(target_disks, parent_disks, area, radii, rmax, *params.get())));
+    //The entries are created first so that the relations can be computed in parallel
+    std::vector<std::vector<Target_pcf_type> *> pcfs;
+    for(unsigned long parent : relations)
+    {
+        pcfs.push_back(&target_pcf[parent]);
+    }
+    context->pool->parallelFor(0, relations.size(), 1, [&](unsigned long from, unsigned long to){
+        for(unsigned long r=from; r<to; r++)
+        {
+            unsigned long parent = relations[r];
+            auto & parent_disks = (*categories.get())[parent].target_disks;
+            *pcfs[r] = compute_pcf(target_disks, parent_disks, target_areas.at(parent), target_radii.at(parent), target_rmax.at(parent), *params.get());
+        }
+    });
+    for(auto const & relation : target_pcf)
+    {
+        target_arrays[relation.first] = split_target_pcf(relation.second);
     }
 }
 
 
 
-void Category::initialize(float domainLength, float e_delta){
+Synthesis_status Category::initialize(float domainLength, float e_delta){
+    auto & sink = context->sink;
     if(initialized)
-        return;
-    std::random_device rand_device;
-    std::mt19937_64 rand_gen(rand_device());
-
-    disks.clear();
-    pcf.clear();
+    {
+        replayFinished();
+        return Synthesis_status::completed;
+    }
 
     //Initialize the parents before this one (akin to the topological order)
     for(unsigned long parent : parents_id)
     {
-        (*categories.get())[parent].initialize(domainLength, e_delta);
+        auto parent_status = (*categories.get())[parent].initialize(domainLength, e_delta);
+        if(parent_status != Synthesis_status::completed)
+        {
+            return parent_status;
+        }
     }
 
-    std::vector<float> output_disks_radii;
-
+    TRACE_SCOPE_ARG("Category::initialize", id);
     //Adapt to the domain length
     float n_factor = domainLength*domainLength;
     float diskfact = 1/domainLength;
-    unsigned long long n_repeat = std::ceil(n_factor);
-    output_disks_radii.reserve(n_repeat*target_disks.size());
-    for(auto & d : target_disks)
-    {
-        for(unsigned long long i=0; i<n_repeat; i++)
-        {
-            output_disks_radii.push_back(d.r);
-        }
-    }
     std::uniform_real_distribution<float> randf(0, domainLength);
 
-    std::shuffle(output_disks_radii.begin(), output_disks_radii.end(), rand_gen); //Shuffle array
-    output_disks_radii.resize(target_disks.size()*n_factor); // and resize it to the number of disks we want
-    // This combination effectively does a random non repeating sampling
-
-    std::sort(output_disks_radii.rbegin(), output_disks_radii.rend()); //Sort the radii in descending order
-    finalSize = output_disks_radii.size();
-
-    float e_0 = 0;
-    unsigned long max_fails=1000;
-    unsigned long fails=0;
-    unsigned long n_accepted=0;
-    disks.reserve(output_disks_radii.size());
     auto nSteps = (unsigned long)(params->limit/params->step);
     std::vector<unsigned long> relations;
     relations.reserve(1+parents_id.size());
@@ -121,144 +144,934 @@ void Category::initialize(float domainLength, float e_delta){
     auto & others = *categories.get();
     auto & parameters = *params.get();
 
-    constexpr unsigned long MAX_LONG = std::numeric_limits<unsigned long>::max();
-    std::map<unsigned long, std::vector<std::vector<float>>> weights;
-    std::map<unsigned long, std::vector<float>> current_pcf;
+    //Counters of this initialization, published in stats with each accepted disk
+    auto run_start = std::chrono::steady_clock::now();
+    Category_stats run = in_progress ? stats : Category_stats();
+    auto class_tolerance = parameters.class_tolerance.find(id);
+    auto const & tolerance_schedule = class_tolerance != parameters.class_tolerance.end() ? class_tolerance->second : parameters.tolerance;
+    ToleranceSchedule tolerance(tolerance_schedule, e_delta, state.tolerance);
+    run.tolerance_schedule = tolerance_schedule.type;
+    double previous_seconds = run.initialize_seconds;
+    auto elapsed = [](std::chrono::steady_clock::time_point since){
+        return std::chrono::duration<double>(std::chrono::steady_clock::now()-since).count();
+    };
 
-    //Compute the weights for each realtion disks
-    for(auto relation : relations){
-        current_pcf.insert(std::make_pair(relation, 0));
-        current_pcf[relation].resize(nSteps, 0);
-        weights.insert(std::make_pair(relation, get_weights(others[relation].disks, target_radii[relation], diskfact)));
+    auto & rand_gen = state.rand_gen;
+    auto & output_disks_radii = state.output_disks_radii;
+    auto & n_accepted = state.n_accepted;
+    auto & fails = state.fails;
+    auto & weights = state.weights;
+    auto & parent_weights = state.parent_weights;
+    auto & current_pcf = state.current_pcf;
+
+    if(in_progress)
+    {
+        //Resumed from a checkpoint or after a stopped initialization, the disks accepted so far are given to the restarted sink
+        if(sink)
+        {
+            sink->beginCategory(id, finalSize);
+            for(auto const & d : disks)
+            {
+                sink->addDisk(id, d);
+            }
+        }
+        replay_sink = false;
+    }else
+    {
+        if(params->seed)
+        {
+            //Every class gets its own sequence
+            std::seed_seq seq{(unsigned int)params->seed, (unsigned int)(params->seed >> 32), (unsigned int)id};
+            rand_gen.seed(seq);
+        }else
+        {
+            std::random_device rand_device;
+            rand_gen.seed(rand_device());
+        }
+
+        disks_access.lock();
+        disks.clear();
+        generation++;
+        disks_access.unlock();
+        pcf.clear();
+
+        unsigned long long n_repeat = std::ceil(n_factor);
+        //The fixed disks take the place of some of the disks we want
+        auto n_wanted = (unsigned long)(target_disks.size()*n_factor);
+        auto n_fixed = (unsigned long)fixed_disks.size();
+        //Random non repeating sampling of the target radii, each available n_repeat times, sorted in descending order
+        std::vector<float> sampled_radii = sample_radii(target_disks, n_repeat, n_wanted > n_fixed ? n_wanted-n_fixed : 0, rand_gen);
+
+        output_disks_radii.clear();
+        output_disks_radii.reserve(n_fixed + sampled_radii.size());
+        for(auto const & d : fixed_disks)
+        {
+            output_disks_radii.push_back(d.r);
+        }
+        output_disks_radii.insert(output_disks_radii.end(), sampled_radii.begin(), sampled_radii.end());
+        finalSize = output_disks_radii.size();
+        if(sink)
+        {
+            sink->beginCategory(id, finalSize);
+        }
+
+        fails=0;
+        n_accepted=0;
+        state.grid_search=false;
+        state.dart_seconds=0;
+        state.grid_seconds=0;
+        state.darts_per_accept=0;
+        state.sampler = Sampler_state();
+        tolerance.start();
+        disks_access.lock();
+        disks.reserve(output_disks_radii.size());
+        disks_access.unlock();
+
+        //Compute the weights for each realtion disks
+        current_pcf.clear();
+        parent_weights.clear();
+        for(auto relation : relations){
+            current_pcf.insert(std::make_pair(relation, 0));
+            current_pcf[relation].resize(nSteps, 0);
+            if(relation == id)
+            {
+                weights = get_weights(disks, target_radii[relation], diskfact, parameters.periodic);
+            }else
+            {
+                //The parents are complete, their weights are the same for each of their children
+                auto const & parent = others[relation];
+                parent_weights[relation] = context->weights->get(relation, parent.generation, parent.disks, target_radii[relation], domainLength, parameters.periodic);
+            }
+        }
+        in_progress = true;
     }
+    auto weights_of = [&](unsigned long relation) -> std::vector<std::vector<float>> const & {
+        return relation == id ? weights : *parent_weights.at(relation);
+    };
+    //Copies of the disks of the relations in Morton order, the own one rebuilt as add would have left it and the ones of the parents
+    //shared with their other children
+    std::map<unsigned long, std::shared_ptr<const SpatialDisks>> spatial;
+    std::shared_ptr<SpatialDisks> own_spatial;
+    if(parameters.spatial_sort)
+    {
+        for(auto relation : relations)
+        {
+            if(relation == id)
+            {
+                own_spatial = std::make_shared<SpatialDisks>(domainLength, nSteps);
+                own_spatial->assign(disks, weights, true);
+                spatial[relation] = own_spatial;
+            }else
+            {
+                auto const & parent = others[relation];
+                spatial[relation] = context->weights->getSorted(relation, parent.generation, parent.disks, target_radii[relation], domainLength, parameters.periodic);
+            }
+        }
+    }
+    post({Synthesis_event::category_started, Synthesis_phase::initialization, Synthesis_status::completed, id, n_accepted, finalSize});
+    //The accepted disks are reported by batches
+    unsigned long reported = n_accepted;
+    auto report_time = std::chrono::steady_clock::now();
+
+    constexpr unsigned long MAX_LONG = std::numeric_limits<unsigned long>::max();
+
+    //Contribution of a disk to the pcf of a relation, from the Morton ordered copy of its disks if there is one
+    auto contribution_to = [&](Disk const & d, unsigned long relation, unsigned long target_size){
+        unsigned long same_category_index = relation == id ? n_accepted : MAX_LONG;
+        auto sorted = spatial.find(relation);
+        if(sorted != spatial.end())
+        {
+            return compute_contribution(d, *sorted->second, target_radii[relation], target_areas[relation], target_rmax[relation], parameters, same_category_index, target_size, diskfact);
+        }
+        return compute_contribution(d, others[relation].disks, weights_of(relation), target_radii[relation], target_areas[relation], target_rmax[relation], parameters, same_category_index, target_size, diskfact);
+    };
 
     std::map<unsigned long, Contribution> contributions;
 
-    do{
-        bool rejected=false;
-        float e = e_0 + e_delta*fails;
-        //Generate a random disk
-        Disk d_test(randf(rand_gen), randf(rand_gen), output_disks_radii[n_accepted]);
+    //Adds an accepted disk and its contributions to the current pcfs
+    auto accept = [&](Disk const & d, std::map<unsigned long, Contribution> & contribs){
+        run.initialize_seconds = previous_seconds + elapsed(run_start);
+        disks_access.lock();
+        disks.push_back(d);
+        stats = run;
+        disks_access.unlock();
+        context->notifier.notify();
+        if(sink)
+        {
+            sink->addDisk(id, d);
+        }
         for(auto relation : relations)
         {
-            Contribution test_pcf;
-            if(!disks.empty() || relation != id)
+            auto & current = current_pcf[relation];
+            auto & contrib = contribs[relation];
+            if(relation == id)
             {
-                //Computing the contribution of this disk to the pcf for this relation
-                test_pcf = compute_contribution(d_test, others[relation].disks, weights[relation], target_radii[relation], target_areas[relation], target_rmax[relation], parameters, relation == id ? n_accepted : MAX_LONG,relation == id ? 2*output_disks_radii.size()*output_disks_radii.size() : 2*output_disks_radii.size()*others[relation].disks.size(), diskfact);
-                if(e < compute_error(test_pcf, current_pcf[relation], target_pcf[relation]))
+                weights.emplace_back(contrib.weights);
+                if(own_spatial)
                 {
-                    //Disk is rejected if the error is too high
-                    rejected=true;
-                    break;
+                    own_spatial->add(d, contrib.weights);
                 }
-            }else{
+            }
+            for(unsigned long k=0; k<nSteps; k++)
+            {
+                current[k]+=contrib.contribution[k];
+            }
+        }
+        n_accepted++;
+        if(context->observers && (n_accepted - reported >= ACCEPTED_EVENT_BATCH || elapsed(report_time) >= ACCEPTED_EVENT_PERIOD))
+        {
+            if(post({Synthesis_event::disks_accepted, Synthesis_phase::initialization, Synthesis_status::completed, id, n_accepted, finalSize}, true))
+            {
+                reported = n_accepted;
+                report_time = std::chrono::steady_clock::now();
+            }
+        }
+    };
 
-                test_pcf.pcf.resize(nSteps, 0);
-                test_pcf.contribution.resize(nSteps, 0);
-                test_pcf.weights = get_weight(d_test, target_radii[relation], diskfact);
+    //The fixed disks are accepted first, whatever their error
+    for(unsigned long f=n_accepted; f<fixed_disks.size(); f++)
+    {
+        auto const & d_fixed = fixed_disks[f];
+        for(auto relation : relations)
+        {
+            Contribution fixed_pcf;
+            if(!disks.empty() || relation != id)
+            {
+                fixed_pcf = contribution_to(d_fixed, relation, relation == id ? 2*output_disks_radii.size()*output_disks_radii.size() : 2*output_disks_radii.size()*others[relation].disks.size());
+            }else{
+                fixed_pcf.pcf.resize(nSteps, 0);
+                fixed_pcf.contribution.resize(nSteps, 0);
+                fixed_pcf.weights = get_weight(d_fixed, target_radii[relation], diskfact, parameters.periodic);
             }
-            contributions.insert_or_assign(relation, test_pcf);
+            contributions.insert_or_assign(relation, fixed_pcf);
         }
-        if(rejected)
+        accept(d_fixed, contributions);
+    }
+
+    //Stops the initialization with the disks accepted so far, it can be resumed by calling initialize again
+    auto & cancellation = *context->cancellation;
+    auto & pool = *context->pool;
+    auto stop = [&](Synthesis_status status){
+        run.initialize_seconds = previous_seconds + elapsed(run_start);
+        disks_access.lock();
+        stats = run;
+        disks_access.unlock();
+        if(sink)
         {
-            fails++;
-        }else
+            sink->endCategory(id);
+        }
+        checkpoint(true);
+        context->notifier.notify();
+        post({Synthesis_event::category_finished, Synthesis_phase::initialization, status, id, n_accepted, finalSize});
+        return status;
+    };
+
+    //Grid search
+    constexpr unsigned long N_I = 100;
+    constexpr unsigned long N_J = 100;
+    std::unique_ptr<std::map<unsigned long, Contribution>[][N_J]> contribs;
+
+    std::unique_ptr<DartSampler> sampler;
+    if(parameters.importance_sampling)
+    {
+        sampler.reset(new DartSampler(state.sampler, (unsigned long)std::ceil(parameters.sampler_cells*domainLength), domainLength));
+    }
+
+    //Error of a disk with the current pcfs, the worst of its relations, and its contributions
+    auto evaluate = [&](Disk const & d, std::map<unsigned long, Contribution> & point_contributions){
+        float error = 0;
+        for(auto relation : relations)
+        {
+            Contribution test_pcf = contribution_to(d, relation, relation == id ? output_disks_radii.size()*output_disks_radii.size() : output_disks_radii.size()*others[relation].disks.size());
+            error = std::max(error, compute_error(test_pcf, current_pcf[relation], target_arrays.at(relation)));
+            point_contributions.insert_or_assign(relation, std::move(test_pcf));
+        }
+        return error;
+    };
+
+    //Hierarchical grid search : a coarse grid with about one point per rmax, then the best points are refined until the spacing
+    //is a fraction of the pcf step
+    auto coarse_n = clip<unsigned long>((unsigned long)std::ceil(domainLength/target_rmax[id]), 8, 128);
+    float coarse_spacing = domainLength/coarse_n;
+    float fine_spacing = parameters.step*target_rmax[id]/2;
+    unsigned long refine_candidates = std::max(1ul, parameters.grid_refine_candidates);
+    unsigned long refine_levels = 0;
+    for(float h = coarse_spacing; h > fine_spacing; h /= 3)
+    {
+        refine_levels++;
+    }
+    unsigned long sweep_points = parameters.hierarchical_grid ? coarse_n*coarse_n + refine_levels*refine_candidates*8 : (N_I-1)*(N_J-1);
+
+    //The adaptive switch compares the time spent by the darts on a disk with the time of a grid search sweep, which places a disk
+    bool adaptive_switch = parameters.adaptive_switch;
+    auto streak_start = std::chrono::steady_clock::now();
+    unsigned long streak_darts = 0;
+    auto sweep_seconds = [&](double dart_seconds){
+        //Until a sweep is measured, a point of the grid is assumed to cost a dart
+        return state.grid_seconds > 0 ? state.grid_seconds : dart_seconds*sweep_points/pool.size();
+    };
+    auto enter_grid_search = [&](){
+        state.grid_search = true;
+        post({Synthesis_event::grid_search_entered, Synthesis_phase::initialization, Synthesis_status::completed, id, n_accepted, finalSize});
+        run.grid_search_entries++;
+        run.addFailStreak(fails);
+    };
+
+    while(n_accepted < output_disks_radii.size()){
+        auto status = cancellation.check();
+        if(status != Synthesis_status::completed)
+        {
+            return stop(status);
+        }
+        if(!state.grid_search)
         {
-            //The disk is accepted, we add it to the list
-            disks_access.lock();
-            disks.push_back(d_test);
-            disks_access.unlock();
-            fails=0;
+            bool rejected=false;
+            float e = tolerance.tolerance();
+            float rejected_error = 0;
+            run.darts_thrown++;
+            run.e_sum += e;
+            //Generate a random disk
+            unsigned long sampled_cell = 0;
+            Disk d_test(0, 0, output_disks_radii[n_accepted]);
+            if(sampler)
+            {
+                sampled_cell = sampler->sample(rand_gen, d_test.x, d_test.y);
+            }else
+            {
+                d_test = Disk(randf(rand_gen), randf(rand_gen), output_disks_radii[n_accepted]);
+            }
             for(auto relation : relations)
             {
-                auto & current = current_pcf[relation];
-                auto & contrib = contributions[relation];
-                if(relation == id)
+                Contribution test_pcf;
+                if(!disks.empty() || relation != id)
+                {
+                    //Computing the contribution of this disk to the pcf for this relation
+                    test_pcf = contribution_to(d_test, relation, relation == id ? 2*output_disks_radii.size()*output_disks_radii.size() : 2*output_disks_radii.size()*others[relation].disks.size());
+                    float error = compute_error(test_pcf, current_pcf[relation], target_arrays.at(relation));
+                    if(e < error)
+                    {
+                        //Disk is rejected if the error is too high
+                        rejected=true;
+                        rejected_error = error;
+                        break;
+                    }
+                }else{
+
+                    test_pcf.pcf.resize(nSteps, 0);
+                    test_pcf.contribution.resize(nSteps, 0);
+                    test_pcf.weights = get_weight(d_test, target_radii[relation], diskfact, parameters.periodic);
+                }
+                contributions.insert_or_assign(relation, test_pcf);
+            }
+            streak_darts++;
+            if(rejected)
+            {
+                fails++;
+                run.darts_rejected++;
+                tolerance.rejected(fails);
+                if(sampler)
+                {
+                    sampler->rejected(sampled_cell, e, rejected_error);
+                }
+            }else
+            {
+                //The disk is accepted, we add it to the list
+                run.darts_accepted++;
+                run.addFailStreak(fails);
+                tolerance.accepted(fails);
+                fails=0;
+                if(sampler)
                 {
-                    weights[relation].emplace_back(contrib.weights);
+                    sampler->accepted();
                 }
-                for(unsigned long k=0; k<nSteps; k++)
+                accept(d_test, contributions);
+                checkpoint(false);
+            }
+
+            if(!adaptive_switch)
+            {
+                if(fails > parameters.max_fails)
                 {
-                    current[k]+=contrib.contribution[k];
+                    //We have exceeded the fails threshold, we switch to a parallel grid search until the end
+                    enter_grid_search();
                 }
+                continue;
             }
-            n_accepted++;
+            double spent = elapsed(streak_start);
+            if(!rejected)
+            {
+                auto average = [](double & value, double measure){ value = value > 0 ? value + SWITCH_SMOOTHING*(measure-value) : measure; };
+                average(state.dart_seconds, spent/streak_darts);
+                average(state.darts_per_accept, streak_darts);
+                streak_start = std::chrono::steady_clock::now();
+                streak_darts = 0;
+                //The acceptance rate dropped so much that the darts are expected to cost more than a sweep for the next disk
+                if(n_accepted < output_disks_radii.size() && state.darts_per_accept*state.dart_seconds > sweep_seconds(state.dart_seconds))
+                {
+                    enter_grid_search();
+                }
+            }else if(spent > sweep_seconds(state.dart_seconds > 0 ? state.dart_seconds : spent/streak_darts))
+            {
+                //This disk already cost a sweep in darts, switching now costs at most twice the best choice
+                if(state.dart_seconds <= 0)
+                {
+                    //No dart was accepted yet, the cost of these darts is the estimate the grid search compares to for going back
+                    state.dart_seconds = spent/streak_darts;
+                }
+                enter_grid_search();
+            }
+            continue;
         }
 
-        if(fails > max_fails)
+        TRACE_SCOPE_ARG("grid search", id);
+        auto grid_start = std::chrono::steady_clock::now();
+        std::atomic<Synthesis_status> grid_status{Synthesis_status::completed};
+        Disk d_best(0, 0, output_disks_radii[n_accepted]);
+        std::map<unsigned long, Contribution> * best_contributions;
+        std::vector<float> sweep_errors; // Errors of a regular grid of the domain, for the adaptive switch
+        std::vector<Grid_point> points;
+        if(!parameters.hierarchical_grid)
         {
-            //We have exceeded the 1000 fails threshold, we switch to a parallel grid search
-            std::cout << "Grid searching : " << id <<std::endl;
-            //Grid search
-            constexpr unsigned long N_I = 100;
-            constexpr unsigned long N_J = 100;
-            std::map<unsigned long, Contribution> contribs[N_I][N_J];
-            while(n_accepted < output_disks_radii.size())
+            if(!contribs)
             {
-                float errors[N_I+1][N_J+1];
-                Compare minError = {INFINITY,0, 0};
-#pragma omp parallel for default(none) collapse(2) shared(output_disks_radii, n_accepted, relations, others, parameters, nSteps, errors, diskfact, contribs, weights, current_pcf, domainLength)
-                for(unsigned long i=1; i<N_I; i++)
+                std::cout << "Grid searching : " << id <<std::endl;
+                contribs.reset(new std::map<unsigned long, Contribution>[N_I][N_J]);
+            }
+            auto & cells = contribs;
+            float errors[N_I+1][N_J+1];
+            Compare minError = {INFINITY,0, 0};
+            //The cells are numbered row by row, so that the chunks of the pool are about the same size
+            pool.parallelFor(0, (N_I-1)*(N_J-1), 1, [&](unsigned long from, unsigned long to){
+                TRACE_SCOPE("grid search worker");
+                for(unsigned long c=from; c<to; c++)
                 {
-                    for(unsigned long j=1; j<N_J; j++)
+                    unsigned long i = 1 + c/(N_J-1);
+                    unsigned long j = 1 + c%(N_J-1);
+                    //The remaining cells are skipped once the search is stopped
+                    if(grid_status.load(std::memory_order_relaxed) != Synthesis_status::completed)
                     {
-                        float currentError=0;
-                        Disk cell_test((domainLength/N_I)*i, (domainLength/N_J)*j, output_disks_radii[n_accepted]);
-                        for(auto && relation : relations)
-                        {
-                            Contribution test_pcf;
-                            test_pcf = compute_contribution(cell_test, others[relation].disks, weights[relation], target_radii[relation], target_areas[relation], target_rmax[relation], parameters, relation == id ? n_accepted : MAX_LONG, relation == id ? output_disks_radii.size()*output_disks_radii.size() : output_disks_radii.size()*others[relation].disks.size(), diskfact);
-                            currentError = std::max(currentError, compute_error(test_pcf, current_pcf[relation], target_pcf[relation]));
-                            contribs[i][j].insert_or_assign(relation, test_pcf);
-                        }
-
-                        errors[i][j] = currentError;
+                        return;
                     }
+                    auto cell_status = cancellation.check();
+                    if(cell_status != Synthesis_status::completed)
+                    {
+                        grid_status.store(cell_status, std::memory_order_relaxed);
+                        return;
+                    }
+                    float currentError=0;
+                    Disk cell_test((domainLength/N_I)*i, (domainLength/N_J)*j, output_disks_radii[n_accepted]);
+                    for(auto && relation : relations)
+                    {
+                        Contribution test_pcf;
+                        test_pcf = contribution_to(cell_test, relation, relation == id ? output_disks_radii.size()*output_disks_radii.size() : output_disks_radii.size()*others[relation].disks.size());
+                        currentError = std::max(currentError, compute_error(test_pcf, current_pcf[relation], target_arrays.at(relation)));
+                        cells[i][j].insert_or_assign(relation, test_pcf);
+                    }
+
+                    errors[i][j] = currentError;
                 }
+            });
 
-                for(unsigned long i=1; i<N_I; i++)
+            if(grid_status != Synthesis_status::completed)
+            {
+                run.grid_search_seconds += elapsed(grid_start);
+                return stop(grid_status);
+            }
+            run.grid_search_evaluations += (N_I-1)*(N_J-1);
+
+            for(unsigned long i=1; i<N_I; i++)
+            {
+                for(unsigned long j=1; j<N_J; j++)
                 {
-                    for(unsigned long j=1; j<N_J; j++)
+                    if(errors[i][j] < minError.val)
                     {
-                        if(errors[i][j] < minError.val)
-                        {
-                            minError.val = errors[i][j];
-                            minError.i = i;
-                            minError.j = j;
-                        }
+                        minError.val = errors[i][j];
+                        minError.i = i;
+                        minError.j = j;
                     }
                 }
-
-                //We automatically accept the disk with the lowest error
-                disks_access.lock();
-                disks.emplace_back((domainLength/N_I)*minError.i + (randf(rand_gen)-domainLength/2)/(N_I*10), (domainLength/N_J)*minError.j + (randf(rand_gen)-domainLength/2)/(N_J*10), output_disks_radii[n_accepted]);
-                disks_access.unlock();
-                for(auto relation : relations)
+                if(adaptive_switch)
                 {
-                    auto & current = current_pcf[relation];
-                    auto & contrib = contribs[minError.i][minError.j][relation];
-                    if(relation == id)
+                    sweep_errors.insert(sweep_errors.end(), errors[i]+1, errors[i]+N_J);
+                }
+            }
+
+            //We automatically accept the disk with the lowest error
+            d_best = Disk((domainLength/N_I)*minError.i + (randf(rand_gen)-domainLength/2)/(N_I*10), (domainLength/N_J)*minError.j + (randf(rand_gen)-domainLength/2)/(N_J*10), output_disks_radii[n_accepted]);
+            if(parameters.periodic)
+            {
+                //The jitter can leave the domain, wrap it back
+                d_best.x -= domainLength*std::floor(d_best.x/domainLength);
+                d_best.y -= domainLength*std::floor(d_best.y/domainLength);
+            }
+            best_contributions = &cells[minError.i][minError.j];
+        }else
+        {
+            //Evaluates the points from a position on, in parallel
+            auto evaluate_points = [&](unsigned long from){
+                unsigned long n_points = points.size();
+                pool.parallelFor(from, n_points, 1, [&](unsigned long first, unsigned long last){
+                    for(unsigned long p=first; p<last; p++)
                     {
-                        weights[relation].emplace_back(contrib.weights);
+                        if(grid_status.load(std::memory_order_relaxed) != Synthesis_status::completed)
+                        {
+                            return;
+                        }
+                        auto point_status = cancellation.check();
+                        if(point_status != Synthesis_status::completed)
+                        {
+                            grid_status.store(point_status, std::memory_order_relaxed);
+                            return;
+                        }
+                        points[p].error = evaluate(points[p].d, points[p].contributions);
                     }
-                    for(unsigned long k=0; k<nSteps; k++)
+                });
+                run.grid_search_evaluations += n_points-from;
+                return grid_status.load() == Synthesis_status::completed;
+            };
+            points.reserve(sweep_points);
+            //The coarse grid is randomly offset, so that the placements are not aligned on a lattice
+            std::uniform_real_distribution<float> offset(0, coarse_spacing);
+            float offset_x = offset(rand_gen);
+            float offset_y = offset(rand_gen);
+            for(unsigned long i=0; i<coarse_n; i++)
+            {
+                for(unsigned long j=0; j<coarse_n; j++)
+                {
+                    points.push_back({Disk(offset_x+coarse_spacing*i, offset_y+coarse_spacing*j, output_disks_radii[n_accepted]), INFINITY, {}});
+                }
+            }
+            bool evaluated = evaluate_points(0);
+            if(evaluated && adaptive_switch)
+            {
+                for(auto const & point : points)
+                {
+                    sweep_errors.push_back(point.error);
+                }
+            }
+            for(float h = coarse_spacing; evaluated && h > fine_spacing; h /= 3)
+            {
+                //Keeps the best points and evaluates their 8 neighbours at a third of the spacing
+                auto kept = std::min(refine_candidates, (unsigned long)points.size());
+                std::partial_sort(points.begin(), points.begin()+kept, points.end(), [](Grid_point const & a, Grid_point const & b){ return a.error < b.error; });
+                points.erase(points.begin()+kept, points.end());
+                float sub = h/3;
+                for(unsigned long c=0; c<kept; c++)
+                {
+                    for(int a=-1; a<=1; a++)
                     {
-                        current[k]+=contrib.contribution[k];
+                        for(int b=-1; b<=1; b++)
+                        {
+                            if(a == 0 && b == 0)
+                            {
+                                continue;
+                            }
+                            float x = points[c].d.x + a*sub;
+                            float y = points[c].d.y + b*sub;
+                            if(parameters.periodic)
+                            {
+                                x -= domainLength*std::floor(x/domainLength);
+                                y -= domainLength*std::floor(y/domainLength);
+                            }else if(x < 0 || x >= domainLength || y < 0 || y >= domainLength)
+                            {
+                                continue;
+                            }
+                            points.push_back({Disk(x, y, output_disks_radii[n_accepted]), INFINITY, {}});
+                        }
                     }
                 }
-                n_accepted++;
+                evaluated = evaluate_points(kept);
+            }
+            if(!evaluated)
+            {
+                run.grid_search_seconds += elapsed(grid_start);
+                return stop(grid_status);
             }
+            auto best = std::min_element(points.begin(), points.end(), [](Grid_point const & a, Grid_point const & b){ return a.error < b.error; });
+            d_best = best->d;
+            best_contributions = &best->contributions;
+        }
+        double sweep = elapsed(grid_start);
+        run.grid_search_accepted++;
+        run.grid_search_seconds += sweep;
+        if(sampler)
+        {
+            sampler->accepted();
+        }
+        accept(d_best, *best_contributions);
+        checkpoint(false);
 
+        if(adaptive_switch && state.dart_seconds > 0 && n_accepted < output_disks_radii.size())
+        {
+            state.grid_seconds = state.grid_seconds > 0 ? state.grid_seconds + SWITCH_SMOOTHING*(sweep-state.grid_seconds) : sweep;
+            //The acceptance of a dart is estimated by the part of the cells with an error below the tolerance, following the schedule
+            std::sort(sweep_errors.begin(), sweep_errors.end());
+            Tolerance_state simulated = state.tolerance;
+            ToleranceSchedule simulation(tolerance_schedule, e_delta, simulated);
+            simulation.accepted(fails);
+            double max_darts = SWITCH_BACK_MARGIN*state.grid_seconds/state.dart_seconds;
+            double expected_darts = 0, miss = 1;
+            for(unsigned long n=0; miss > 1e-3 && expected_darts < max_darts; n++)
+            {
+                expected_darts += miss;
+                auto below = std::upper_bound(sweep_errors.begin(), sweep_errors.end(), simulation.tolerance()) - sweep_errors.begin();
+                miss *= 1-double(below)/sweep_errors.size();
+                simulation.rejected(n+1);
+            }
+            if(expected_darts < max_darts)
+            {
+                //The acceptance recovered, back to the darts
+                state.grid_search = false;
+                state.darts_per_accept = expected_darts;
+                tolerance.accepted(fails);
+                fails = 0;
+                streak_start = std::chrono::steady_clock::now();
+                streak_darts = 0;
+                run.grid_search_exits++;
+                post({Synthesis_event::grid_search_left, Synthesis_phase::initialization, Synthesis_status::completed, id, n_accepted, finalSize});
+            }
         }
-    }while(n_accepted < output_disks_radii.size());
+    }
+    auto final_start = std::chrono::steady_clock::now();
     for(auto r : relations)
     {
         //We're done with the initialisation, we recompute a pcf for the whole class to eliminate round off errors and such
-        pcf.insert_or_assign(r, compute_pcf(disks, others[r].disks, target_areas[r], target_radii[r], target_rmax[r], parameters));
+        pcf.insert_or_assign(r, compute_pcf(disks, others[r].disks, target_areas[r], target_radii[r], target_rmax[r], parameters, domainLength, parameters.periodic ? domainLength : 0));
     }
+    run.final_pcf_seconds = elapsed(final_start);
+    run.initialize_seconds = previous_seconds + elapsed(run_start);
+    disks_access.lock();
+    stats = run;
+    disks_access.unlock();
     initialized=true;
+    in_progress=false;
+    state.clear();
+    if(sink)
+    {
+        sink->endCategory(id);
+    }
+    checkpoint(true);
+    context->notifier.notify();
+    post({Synthesis_event::category_finished, Synthesis_phase::initialization, Synthesis_status::completed, id, finalSize, finalSize});
+    return Synthesis_status::completed;
+}
 
+void Category::copyTargetFrom(Category const & other){
+    parents_id = other.parents_id;
+    children_id = other.children_id;
+    target_pcf = other.target_pcf;
+    target_arrays = other.target_arrays;
+    target_rmax = other.target_rmax;
+    target_areas = other.target_areas;
+    target_radii = other.target_radii;
+    target_disks = other.target_disks;
+}
+
+void Category::hashTarget(uint64_t & hash) const{
+    uint64_t value = id;
+    hashBytes(hash, &value, sizeof(value));
+    value = parents_id.size();
+    hashBytes(hash, &value, sizeof(value));
+    for(auto parent : parents_id)
+    {
+        value = parent;
+        hashBytes(hash, &value, sizeof(value));
+    }
+    value = target_disks.size();
+    hashBytes(hash, &value, sizeof(value));
+    hashBytes(hash, target_disks.data(), target_disks.size()*sizeof(Disk));
+}
+
+void Category::writeTarget(std::ostream & out) const{
+    writePod<uint64_t>(out, target_pcf.size());
+    for(auto & relation : target_pcf)
+    {
+        writePod<uint64_t>(out, relation.first);
+        writePod(out, target_rmax.at(relation.first));
+        writeVector(out, target_areas.at(relation.first));
+        writeVector(out, target_radii.at(relation.first));
+        writeVector(out, relation.second);
+    }
+}
+
+bool Category::readTarget(std::istream & in){
+    std::map<unsigned long, std::vector<Target_pcf_type>> new_pcf;
+    std::map<unsigned long, float> new_rmax;
+    std::map<unsigned long, std::vector<float>> new_areas;
+    std::map<unsigned long, std::vector<float>> new_radii;
+    uint64_t n_relations;
+    if(!readPod(in, n_relations) || n_relations > parents_id.size()+1)
+    {
+        return false;
+    }
+    for(uint64_t i=0; i<n_relations; i++)
+    {
+        uint64_t relation;
+        float rmax;
+        std::vector<float> areas, radii;
+        std::vector<Target_pcf_type> relation_pcf;
+        if(!readPod(in, relation) || !readPod(in, rmax) || !readVector(in, areas) || !readVector(in, radii) || !readVector(in, relation_pcf))
+        {
+            return false;
+        }
+        if(relation != id && std::find(parents_id.begin(), parents_id.end(), relation) == parents_id.end())
+        {
+            return false;
+        }
+        new_rmax[relation] = rmax;
+        new_areas[relation] = std::move(areas);
+        new_radii[relation] = std::move(radii);
+        new_pcf[relation] = std::move(relation_pcf);
+    }
+    target_pcf = std::move(new_pcf);
+    target_arrays.clear();
+    for(auto const & relation : target_pcf)
+    {
+        target_arrays[relation.first] = split_target_pcf(relation.second);
+    }
+    target_rmax = std::move(new_rmax);
+    target_areas = std::move(new_areas);
+    target_radii = std::move(new_radii);
+    return true;
+}
+
+void Category::setFixedDisks(std::vector<Disk> fixed){
+    fixed_disks = std::move(fixed);
+}
+
+unsigned long Category::getFixedDisksCount(){
+    return fixed_disks.size();
+}
+
+void Category::reset(){
+    disks_access.lock();
+    disks.clear();
+    generation++;
+    disks_access.unlock();
+    pcf.clear();
+    stats = Category_stats();
+    initialized = false;
+    in_progress = false;
+    replay_sink = false;
+    state.clear();
+    finalSize = 0;
+}
+
+Category_stats Category::getStats(){
+    std::lock_guard<std::mutex> lock(disks_access);
+    return stats;
+}
+
+void Category::addStats(Category_stats const & other){
+    std::lock_guard<std::mutex> lock(disks_access);
+    stats += other;
+}
+
+bool Category::post(Synthesis_event const & event, bool droppable){
+    return context->observers ? context->observers->post(event, droppable) : false;
+}
+
+void Category::checkpoint(bool force){
+    if(context->checkpoint)
+    {
+        context->checkpoint(force);
+    }
+}
+
+void Category::writeState(std::ostream & out) const{
+    uint8_t status = initialized ? 2 : in_progress ? 1 : 0;
+    writePod(out, status);
+    if(status == 0)
+    {
+        return;
+    }
+    writeVector(out, disks);
+    writePod<uint64_t>(out, finalSize);
+    writePod(out, stats);
+    auto write_map = [&out](auto const & map){
+        writePod<uint64_t>(out, map.size());
+        for(auto const & relation : map)
+        {
+            writePod<uint64_t>(out, relation.first);
+            writeVector(out, relation.second);
+        }
+    };
+    if(status == 2)
+    {
+        write_map(pcf);
+        return;
+    }
+    writeVector(out, state.output_disks_radii);
+    writePod<uint64_t>(out, state.n_accepted);
+    writePod<uint64_t>(out, state.fails);
+    writePod<uint8_t>(out, state.grid_search);
+    writePod(out, state.tolerance);
+    writePod(out, state.dart_seconds);
+    writePod(out, state.grid_seconds);
+    writePod(out, state.darts_per_accept);
+    writeVector(out, state.sampler.deficits);
+    writePod(out, state.sampler.scale);
+    std::stringstream rand_state;
+    rand_state << state.rand_gen;
+    writeString(out, rand_state.str());
+    write_map(state.current_pcf);
+    //The weights of the class and of its parents, by relation
+    auto write_weights = [&out](unsigned long relation, std::vector<std::vector<float>> const & weights){
+        writePod<uint64_t>(out, relation);
+        writePod<uint64_t>(out, weights.size());
+        for(auto const & w : weights)
+        {
+            writeVector(out, w);
+        }
+    };
+    writePod<uint64_t>(out, 1 + state.parent_weights.size());
+    write_weights(id, state.weights);
+    for(auto const & relation : state.parent_weights)
+    {
+        write_weights(relation.first, *relation.second);
+    }
+}
+
+bool Category::readState(std::istream & in){
+    reset();
+    uint8_t status;
+    if(!readPod(in, status) || status > 2)
+    {
+        return false;
+    }
+    if(status == 0)
+    {
+        return true;
+    }
+    std::vector<Disk> new_disks;
+    uint64_t size;
+    Category_stats new_stats;
+    if(!readVector(in, new_disks) || !readPod(in, size) || !readPod(in, new_stats))
+    {
+        return false;
+    }
+    auto read_map = [&in](auto & map){
+        uint64_t n, key;
+        if(!readPod(in, n))
+        {
+            return false;
+        }
+        for(uint64_t i=0; i<n; i++)
+        {
+            if(!readPod(in, key) || !readVector(in, map[key]))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    if(status == 2)
+    {
+        if(!read_map(pcf))
+        {
+            reset();
+            return false;
+        }
+    }else
+    {
+        uint64_t n_accepted, fails, n_relations;
+        uint8_t grid_search;
+        std::string rand_state;
+        bool valid = readVector(in, state.output_disks_radii) && readPod(in, n_accepted) && readPod(in, fails)
+                && readPod(in, grid_search) && readPod(in, state.tolerance)
+                && readPod(in, state.dart_seconds) && readPod(in, state.grid_seconds) && readPod(in, state.darts_per_accept)
+                && readVector(in, state.sampler.deficits) && readPod(in, state.sampler.scale) && readString(in, rand_state) && read_map(state.current_pcf) && readPod(in, n_relations);
+        for(uint64_t r=0; valid && r<n_relations; r++)
+        {
+            uint64_t key, n;
+            valid = readPod(in, key) && readPod(in, n);
+            WeightCache::Weights relation_weights;
+            //Read one by one so that a corrupted count fails on the stream
+            std::vector<float> w;
+            for(uint64_t k=0; valid && k<n; k++)
+            {
+                valid = readVector(in, w);
+                relation_weights.push_back(std::move(w));
+            }
+            if(key == id)
+            {
+                state.weights = std::move(relation_weights);
+            }else
+            {
+                state.parent_weights[key] = std::make_shared<const WeightCache::Weights>(std::move(relation_weights));
+            }
+        }
+        std::stringstream rand_stream(rand_state);
+        valid = valid && (rand_stream >> state.rand_gen) && n_accepted == new_disks.size() && n_accepted <= state.output_disks_radii.size();
+        if(!valid)
+        {
+            reset();
+            return false;
+        }
+        state.n_accepted = n_accepted;
+        state.fails = fails;
+        state.grid_search = grid_search;
+        in_progress = true;
+    }
+    disks_access.lock();
+    disks = std::move(new_disks);
+    generation++;
+    disks_access.unlock();
+    finalSize = size;
+    stats = new_stats;
+    initialized = status == 2;
+    replay_sink = true;
+    context->notifier.notify();
+    return true;
+}
+
+void Category::replayFinished(){
+    //Only written if set, so that the children of a class running in parallel only read it once it was replayed
+    if(!replay_sink || !initialized)
+    {
+        return;
+    }
+    auto & sink = context->sink;
+    if(sink)
+    {
+        //Restored from a checkpoint or finished before a stopped initialization, the restarted sink still has to receive the disks
+        sink->beginCategory(id, finalSize);
+        for(auto const & d : disks)
+        {
+            sink->addDisk(id, d);
+        }
+        sink->endCategory(id);
+    }
+    replay_sink = false;
+}
+
+void Category::replayToSink(){
+    replay_sink = initialized;
+}
+
+void Category::startAssembly(){
+    reset();
+}
+
+void Category::appendDisks(std::vector<Disk> const & new_disks){
+    disks_access.lock();
+    disks.insert(disks.end(), new_disks.begin(), new_disks.end());
+    finalSize = disks.size();
+    disks_access.unlock();
+    context->notifier.notify();
+}
+
+void Category::finishAssembly(float domainLength){
+    auto & others = *categories.get();
+    std::vector<unsigned long> relations;
+    relations.push_back(id);
+    relations.insert(relations.end(), parents_id.begin(), parents_id.end());
+    for(auto r : relations)
+    {
+        pcf.insert_or_assign(r, compute_pcf(disks, others[r].disks, target_areas[r], target_radii[r], target_rmax[r], *params.get(), domainLength));
+    }
+    initialized = true;
+    context->notifier.notify();
 }
 
 std::vector<Target_pcf_type> Category::getCurrentPCF(unsigned long parent){
@@ -293,6 +1106,21 @@ std::vector<Disk> Category::getCurrentDisks(){
     return outDisks;
 }
 
+Disks_delta Category::getDisksSince(unsigned long index, unsigned long _generation){
+    Disks_delta delta;
+    disks_access.lock();
+    delta.generation = generation;
+    delta.start = (_generation == generation) ? std::min(index, (unsigned long)disks.size()) : 0;
+    delta.disks.assign(disks.begin()+delta.start, disks.end());
+    disks_access.unlock();
+    return delta;
+}
+
+unsigned long Category::getGeneration(){
+    std::lock_guard<std::mutex> lock(disks_access);
+    return generation;
+}
+
 void Category::addTargetDisk(Disk const &d){
     target_disks.push_back(d);
 }
@@ -342,6 +1170,8 @@ unsigned long Category::getFinalSize(float domainLength){
 
 void Category::normalize(float domainLength)
 {
+    std::lock_guard<std::mutex> lock(disks_access);
+    generation++;
     for(auto & d : disks)
     {
         d.x/=domainLength;
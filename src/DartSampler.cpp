@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cmath>
+#include "../include/DartSampler.h"
+
+DartSampler::DartSampler(Sampler_state & _state, unsigned long _resolution, float _domainLength) : state(_state), resolution(std::max(1ul, _resolution)), domainLength(_domainLength){
+    cell_length = domainLength/resolution;
+    if(state.deficits.size() != resolution*resolution)
+    {
+        state.deficits.assign(resolution*resolution, 0);
+        state.scale = 1;
+    }
+    build();
+}
+
+void DartSampler::build(){
+    unsigned long n = state.deficits.size();
+    tree.assign(n+1, 0);
+    for(unsigned long i=1; i<=n; i++)
+    {
+        tree[i] += state.deficits[i-1];
+        unsigned long parent = i + (i & (~i+1));
+        if(parent <= n)
+        {
+            tree[parent] += tree[i];
+        }
+    }
+}
+
+unsigned long DartSampler::sample(std::mt19937_64 & rand_gen, float & x, float & y){
+    unsigned long n = state.deficits.size();
+    double total_deficit = 0;
+    for(unsigned long i=n; i>0; i -= i & (~i+1))
+    {
+        total_deficit += tree[i];
+    }
+    //Descends the tree to the first cell whose prefix sum of weights exceeds u, a node covering step cells weighs step - scale*deficit
+    double u = std::uniform_real_distribution<double>(0, n - state.scale*total_deficit)(rand_gen);
+    unsigned long position = 0;
+    unsigned long step = 1;
+    while(step*2 <= n)
+    {
+        step *= 2;
+    }
+    for(; step > 0; step /= 2)
+    {
+        if(position + step <= n)
+        {
+            double node_weight = step - state.scale*tree[position + step];
+            if(node_weight <= u)
+            {
+                position += step;
+                u -= node_weight;
+            }
+        }
+    }
+    unsigned long cell = std::min(position, n-1);
+    std::uniform_real_distribution<float> in_cell(0, cell_length);
+    float last = std::nextafter(domainLength, 0.f);
+    x = std::min((cell % resolution)*cell_length + in_cell(rand_gen), last);
+    y = std::min((cell / resolution)*cell_length + in_cell(rand_gen), last);
+    return cell;
+}
+
+void DartSampler::rejected(unsigned long cell, float tolerance, float error){
+    //A dart just above the tolerance barely lowers the weight, one far above it halves it
+    double ratio = error > 0 ? std::min(1.f, std::max(0.f, tolerance/error)) : 1;
+    double factor = REJECTION_FACTOR + (1-REJECTION_FACTOR)*ratio;
+    double weight = std::max<double>(MIN_WEIGHT, (1 - state.scale*state.deficits[cell])*factor);
+    double deficit = (1-weight)/state.scale;
+    double delta = deficit - state.deficits[cell];
+    state.deficits[cell] = deficit;
+    for(unsigned long i=cell+1; i<tree.size(); i += i & (~i+1))
+    {
+        tree[i] += delta;
+    }
+}
+
+void DartSampler::accepted(){
+    state.scale *= 1-RECOVERY;
+    if(state.scale < 1e-6)
+    {
+        //Folds the scale in the deficits before the stored values lose their precision
+        for(auto & d : state.deficits)
+        {
+            d *= state.scale;
+        }
+        state.scale = 1;
+        build();
+    }
+}
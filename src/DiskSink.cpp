@@ -0,0 +1,202 @@
+#include <cstring>
+#include <limits>
+#include "../include/DiskSink.h"
+#include "../include/ExampleFile.h"
+
+static void openOutput(std::ofstream & file, std::string const & filename, std::ios::openmode mode){
+    file.open(filename, mode | std::ios::trunc);
+    if(!file.good())
+    {
+        throw sink_io_error(filename + " : cannot open file for writing");
+    }
+}
+
+void TextDiskSink::begin(std::vector<int> const & class_ids, float domainLength){
+    std::lock_guard<std::mutex> lock(access);
+    openOutput(file, filename, std::ios::out);
+    file.precision(std::numeric_limits<float>::max_digits10);
+    ids = class_ids;
+    scale = 10000.f/domainLength;
+    file << ids.size();
+    for(int id : ids)
+    {
+        file << ' ' << id;
+    }
+    file << '\n';
+}
+
+void TextDiskSink::addDisk(unsigned long category, Disk const & d){
+    std::lock_guard<std::mutex> lock(access);
+    file << ids[category] << ' ' << d.x*scale << ' ' << d.y*scale << ' ' << d.r*scale << '\n';
+}
+
+void TextDiskSink::end(){
+    std::lock_guard<std::mutex> lock(access);
+    file.close();
+}
+
+void CSVDiskSink::begin(std::vector<int> const & class_ids, float domainLength){
+    std::lock_guard<std::mutex> lock(access);
+    openOutput(file, filename, std::ios::out);
+    file.precision(std::numeric_limits<float>::max_digits10);
+    ids = class_ids;
+    file << "class,x,y,r\n";
+}
+
+void CSVDiskSink::addDisk(unsigned long category, Disk const & d){
+    std::lock_guard<std::mutex> lock(access);
+    file << ids[category] << ',' << d.x << ',' << d.y << ',' << d.r << '\n';
+}
+
+void CSVDiskSink::end(){
+    std::lock_guard<std::mutex> lock(access);
+    file.close();
+}
+
+void BinaryDiskSink::begin(std::vector<int> const & class_ids, float domainLength){
+    std::lock_guard<std::mutex> lock(access);
+    //Opened for reading too, the regions are packed by reading them back
+    file.open(filename, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!file.good())
+    {
+        throw sink_io_error(filename + " : cannot open file for writing");
+    }
+    ids = class_ids;
+    scale = 1/domainLength;
+    table.assign(ids.size(), {0, 0});
+    regions.clear();
+    //The class table is written at the end, once the counts and offsets are known
+    file_end = sizeof(Binary_example_header) + ids.size()*sizeof(Binary_example_entry);
+    std::vector<char> reserved(file_end, 0);
+    file.write(reserved.data(), reserved.size());
+}
+
+void BinaryDiskSink::beginCategory(unsigned long category, unsigned long finalSize){
+    std::lock_guard<std::mutex> lock(access);
+    //Started again (resumed), the disks are given again
+    auto & region = regions[category];
+    region = Class_region();
+    reserve(region, finalSize);
+}
+
+void BinaryDiskSink::addDisk(unsigned long category, Disk const & d){
+    std::lock_guard<std::mutex> lock(access);
+    auto & region = regions[category];
+    region.x.push_back(d.x*scale);
+    region.y.push_back(d.y*scale);
+    region.r.push_back(d.r*scale);
+    if(region.x.size() >= FLUSH_SIZE)
+    {
+        flush(region);
+    }
+}
+
+void BinaryDiskSink::endCategory(unsigned long category){
+    std::lock_guard<std::mutex> lock(access);
+    closeCategory(category);
+}
+
+void BinaryDiskSink::reserve(Class_region & region, unsigned long capacity){
+    unsigned long offset = file_end;
+    file_end += 3*capacity*sizeof(float);
+    for(unsigned long component=0; component<3 && region.written > 0; component++)
+    {
+        move(region.offset + component*region.capacity*sizeof(float), offset + component*capacity*sizeof(float), region.written);
+    }
+    region.offset = offset;
+    region.capacity = capacity;
+}
+
+void BinaryDiskSink::flush(Class_region & region){
+    unsigned long count = region.x.size();
+    if(count == 0)
+    {
+        return;
+    }
+    if(region.written + count > region.capacity)
+    {
+        //More disks than announced, the class moves to a region twice as large
+        reserve(region, std::max(2*region.capacity, region.written + count));
+    }
+    unsigned long component=0;
+    for(auto * values : {&region.x, &region.y, &region.r})
+    {
+        file.seekp(region.offset + (component*region.capacity + region.written)*sizeof(float));
+        file.write(reinterpret_cast<char const *>(values->data()), count*sizeof(float));
+        values->clear();
+        component++;
+    }
+    region.written += count;
+}
+
+void BinaryDiskSink::closeCategory(unsigned long category){
+    auto found = regions.find(category);
+    if(found == regions.end())
+    {
+        return;
+    }
+    auto & region = found->second;
+    flush(region);
+    //The format wants y and r right after the disks of x
+    if(region.written < region.capacity)
+    {
+        move(region.offset + region.capacity*sizeof(float), region.offset + region.written*sizeof(float), region.written);
+        move(region.offset + 2*region.capacity*sizeof(float), region.offset + 2*region.written*sizeof(float), region.written);
+    }
+    table[category] = {region.written, region.offset};
+    regions.erase(found);
+}
+
+void BinaryDiskSink::move(unsigned long from, unsigned long to, unsigned long count){
+    std::vector<float> chunk;
+    for(unsigned long done=0; done<count; done+=chunk.size())
+    {
+        chunk.resize(std::min(FLUSH_SIZE, count-done));
+        file.seekg(from + done*sizeof(float));
+        file.read(reinterpret_cast<char *>(chunk.data()), chunk.size()*sizeof(float));
+        file.seekp(to + done*sizeof(float));
+        file.write(reinterpret_cast<char const *>(chunk.data()), chunk.size()*sizeof(float));
+    }
+}
+
+void BinaryDiskSink::end(){
+    std::lock_guard<std::mutex> lock(access);
+    //Classes that were not closed, if the initialization was interrupted
+    while(!regions.empty())
+    {
+        closeCategory(regions.begin()->first);
+    }
+    //The empty classes point to the end of the file
+    file.seekp(0, std::ios::end);
+    unsigned long empty_offset = file.tellp();
+    Binary_example_header header{};
+    std::memcpy(header.magic, BINARY_EXAMPLE_MAGIC, sizeof(header.magic));
+    header.version = BINARY_EXAMPLE_VERSION;
+    header.n_classes = ids.size();
+    file.seekp(0);
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    for(unsigned long c=0; c<ids.size(); c++)
+    {
+        Binary_example_entry entry{};
+        entry.id = ids[c];
+        entry.count = table[c].first;
+        entry.offset = table[c].first == 0 ? empty_offset : table[c].second;
+        file.write(reinterpret_cast<char const *>(&entry), sizeof(entry));
+    }
+    file.close();
+}
+
+std::shared_ptr<DiskSink> createDiskSink(std::string const & filename){
+    auto ends_with = [&filename](std::string const & extension){
+        return filename.size() >= extension.size() && filename.compare(filename.size()-extension.size(), extension.size(), extension) == 0;
+    };
+    if(ends_with(".csv"))
+    {
+        return std::make_shared<CSVDiskSink>(filename);
+    }
+    if(ends_with(".bin"))
+    {
+        return std::make_shared<BinaryDiskSink>(filename);
+    }
+    return std::make_shared<TextDiskSink>(filename);
+}
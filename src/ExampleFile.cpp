@@ -0,0 +1,325 @@
+#include <fstream>
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/ExampleFile.h"
+#include "../include/Trace.h"
+
+/**
+ * Skips spaces and tabs (not line ends)
+ */
+static char const * skipBlanks(char const * p, char const * end){
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * Skips every whitespace and counts the line ends
+ */
+static char const * skipWhitespaces(char const * p, char const * end, unsigned long & line){
+    while(p < end && std::isspace((unsigned char)*p))
+    {
+        line += *p == '\n';
+        p++;
+    }
+    return p;
+}
+
+template<typename T>
+static char const * parseNumber(char const * p, char const * end, T & value){
+    auto result = std::from_chars(p, end, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+/**
+ * Result of the parsing of one chunk of the text example
+ */
+struct Text_chunk{
+    char const * begin;
+    char const * end;
+    unsigned long first_line;
+    std::vector<std::vector<Disk>> disks;
+    unsigned long error_line=0;
+    std::string error;
+};
+
+static void parseChunk(Text_chunk & chunk, std::vector<std::pair<int, unsigned int>> const & class_table){
+    unsigned long line = chunk.first_line;
+    char const * p = chunk.begin;
+    while(p < chunk.end)
+    {
+        p = skipBlanks(p, chunk.end);
+        if(p < chunk.end && *p != '\n')
+        {
+            int id=0;
+            float values[3];
+            char const * q = parseNumber(p, chunk.end, id);
+            for(float & v : values)
+            {
+                q = q ? parseNumber(skipBlanks(q, chunk.end), chunk.end, v) : nullptr;
+            }
+            if(q)
+            {
+                q = skipBlanks(q, chunk.end);
+            }
+            if(!q || (q < chunk.end && *q != '\n'))
+            {
+                chunk.error_line = line;
+                chunk.error = "expected \"class_id x y r\"";
+                return;
+            }
+            auto entry = std::lower_bound(class_table.begin(), class_table.end(), std::make_pair(id, 0U));
+            if(entry == class_table.end() || entry->first != id)
+            {
+                chunk.error_line = line;
+                chunk.error = "unknown class id " + std::to_string(id);
+                return;
+            }
+            chunk.disks[entry->second].emplace_back(values[0]/10000.f, values[1]/10000.f, values[2]/10000.f);
+            p = q;
+        }
+        //Go to the next line
+        p = static_cast<char const *>(std::memchr(p, '\n', chunk.end-p));
+        p = p ? p+1 : chunk.end;
+        line++;
+    }
+}
+
+Example_data loadTextExample(std::string const & filename, ThreadPool & pool){
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if(!file.good())
+    {
+        throw example_format_error(filename + " : cannot open file");
+    }
+    std::string content;
+    content.resize(file.tellg());
+    file.seekg(0);
+    file.read(content.data(), content.size());
+    char const * const begin = content.data();
+    char const * const end = begin + content.size();
+
+    //Header : number of classes, then the class ids
+    Example_data example;
+    unsigned long line = 1;
+    unsigned int n_classes;
+    char const * p = skipWhitespaces(begin, end, line);
+    if(!(p = parseNumber(p, end, n_classes)) || n_classes == 0)
+    {
+        throw example_format_error(filename + ":" + std::to_string(line) + " : expected the number of classes");
+    }
+    std::vector<std::pair<int, unsigned int>> class_table; // Flat table of (class id, class index) sorted by id
+    for(unsigned int i=0; i<n_classes; i++)
+    {
+        int id=0;
+        p = skipWhitespaces(p, end, line);
+        if(!(p = parseNumber(p, end, id)))
+        {
+            throw example_format_error(filename + ":" + std::to_string(line) + " : expected " + std::to_string(n_classes) + " class ids");
+        }
+        example.class_ids.push_back(id);
+        class_table.emplace_back(id, i);
+    }
+    std::sort(class_table.begin(), class_table.end());
+    if(std::adjacent_find(class_table.begin(), class_table.end(), [](auto const & a, auto const & b){ return a.first == b.first; }) != class_table.end())
+    {
+        throw example_format_error(filename + ":" + std::to_string(line) + " : duplicate class id");
+    }
+    p = skipBlanks(p, end);
+    if(p < end && *p == '\n')
+    {
+        p++;
+        line++;
+    }
+
+    //Split the disks in chunks cut at line ends
+    unsigned long n_chunks = std::max(1UL, std::min((unsigned long)pool.size()*4, (unsigned long)(end-p)/(1UL<<16)));
+    std::vector<Text_chunk> chunks(n_chunks);
+    char const * chunk_begin = p;
+    for(unsigned long c=0; c<n_chunks; c++)
+    {
+        char const * chunk_end = c+1 == n_chunks ? end : p + (end-p)*(c+1)/n_chunks;
+        if(chunk_end < chunk_begin)
+        {
+            chunk_end = chunk_begin;
+        }
+        auto const * newline = static_cast<char const *>(std::memchr(chunk_end, '\n', end-chunk_end));
+        chunk_end = newline ? newline+1 : end;
+        chunks[c].begin = chunk_begin;
+        chunks[c].end = chunk_end;
+        chunks[c].disks.resize(n_classes);
+        chunk_begin = chunk_end;
+    }
+
+    //Line numbers of the chunks, then parsing, in parallel
+    std::vector<unsigned long> chunk_lines(n_chunks);
+    pool.parallelFor(0, n_chunks, 1, [&](unsigned long from, unsigned long to){
+        for(unsigned long c=from; c<to; c++)
+        {
+            chunk_lines[c] = std::count(chunks[c].begin, chunks[c].end, '\n');
+        }
+    });
+    for(unsigned long c=0; c<n_chunks; c++)
+    {
+        chunks[c].first_line = line;
+        line += chunk_lines[c];
+    }
+    pool.parallelFor(0, n_chunks, 1, [&](unsigned long from, unsigned long to){
+        for(unsigned long c=from; c<to; c++)
+        {
+            TRACE_SCOPE_ARG("parse chunk", c);
+            parseChunk(chunks[c], class_table);
+        }
+    });
+
+    example.disks.resize(n_classes);
+    for(unsigned int i=0; i<n_classes; i++)
+    {
+        unsigned long count = 0;
+        for(auto const & chunk : chunks)
+        {
+            count += chunk.disks[i].size();
+        }
+        example.disks[i].reserve(count);
+    }
+    for(auto const & chunk : chunks)
+    {
+        if(!chunk.error.empty())
+        {
+            throw example_format_error(filename + ":" + std::to_string(chunk.error_line) + " : " + chunk.error);
+        }
+        for(unsigned int i=0; i<n_classes; i++)
+        {
+            example.disks[i].insert(example.disks[i].end(), chunk.disks[i].begin(), chunk.disks[i].end());
+        }
+    }
+    return example;
+}
+
+bool isBinaryExample(std::string const & filename){
+    std::ifstream file(filename, std::ios::binary);
+    char magic[sizeof(BINARY_EXAMPLE_MAGIC)];
+    if(!file.read(magic, sizeof(magic)))
+    {
+        return false;
+    }
+    return std::memcmp(magic, BINARY_EXAMPLE_MAGIC, sizeof(magic)) == 0;
+}
+
+Example_data loadBinaryExample(std::string const & filename){
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        throw example_format_error(filename + " : cannot open file");
+    }
+    struct stat file_stat{};
+    if(fstat(fd, &file_stat) < 0 || (unsigned long)file_stat.st_size < sizeof(Binary_example_header))
+    {
+        close(fd);
+        throw example_format_error(filename + " : file too small for a binary example");
+    }
+    auto size = (unsigned long)file_stat.st_size;
+    void * mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED)
+    {
+        throw example_format_error(filename + " : cannot map file");
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    auto const * data = static_cast<char const *>(mapped);
+
+    Example_data example;
+    std::string error;
+    auto const * header = reinterpret_cast<Binary_example_header const *>(data);
+    unsigned long table_end = sizeof(Binary_example_header) + (unsigned long)header->n_classes*sizeof(Binary_example_entry);
+    if(std::memcmp(header->magic, BINARY_EXAMPLE_MAGIC, sizeof(BINARY_EXAMPLE_MAGIC)) != 0)
+    {
+        error = "bad magic number";
+    }else if(header->version != BINARY_EXAMPLE_VERSION)
+    {
+        error = "unsupported version " + std::to_string(header->version);
+    }else if(table_end > size)
+    {
+        error = "truncated class table";
+    }else
+    {
+        auto const * entries = reinterpret_cast<Binary_example_entry const *>(data + sizeof(Binary_example_header));
+        example.class_ids.resize(header->n_classes);
+        example.disks.resize(header->n_classes);
+        for(unsigned long c=0; c<header->n_classes && error.empty(); c++)
+        {
+            auto const & entry = entries[c];
+            example.class_ids[c] = entry.id;
+            //The offset is checked first so that the space left after it cannot wrap around, and the count is compared to that space
+            //rather than multiplied, so that offset + 3*count*sizeof(float) cannot overflow
+            if(entry.offset % alignof(float) != 0 || entry.offset < table_end || entry.offset > size || entry.count > (size - entry.offset)/(3*sizeof(float)))
+            {
+                error = "bad data bounds for class " + std::to_string(entry.id);
+                break;
+            }
+            auto const * x = reinterpret_cast<float const *>(data + entry.offset);
+            auto const * y = x + entry.count;
+            auto const * r = y + entry.count;
+            //Disk is an array of structures, the mapped arrays are interleaved in one pass
+            auto & disks = example.disks[c];
+            disks.reserve(entry.count);
+            for(unsigned long i=0; i<entry.count; i++)
+            {
+                disks.emplace_back(x[i], y[i], r[i]);
+            }
+        }
+    }
+    munmap(mapped, size);
+    if(!error.empty())
+    {
+        throw example_format_error(filename + " : " + error);
+    }
+    return example;
+}
+
+void saveBinaryExample(std::string const & filename, Example_data const & example){
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if(!file.good())
+    {
+        throw example_format_error(filename + " : cannot open file for writing");
+    }
+    Binary_example_header header{};
+    std::memcpy(header.magic, BINARY_EXAMPLE_MAGIC, sizeof(header.magic));
+    header.version = BINARY_EXAMPLE_VERSION;
+    header.n_classes = example.disks.size();
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+
+    uint64_t offset = sizeof(Binary_example_header) + example.disks.size()*sizeof(Binary_example_entry);
+    for(unsigned long c=0; c<example.disks.size(); c++)
+    {
+        Binary_example_entry entry{};
+        entry.id = example.class_ids[c];
+        entry.count = example.disks[c].size();
+        entry.offset = offset;
+        offset += 3*entry.count*sizeof(float);
+        file.write(reinterpret_cast<char const *>(&entry), sizeof(entry));
+    }
+    std::vector<float> component;
+    for(auto const & disks : example.disks)
+    {
+        component.resize(disks.size());
+        for(float Disk::* member : {&Disk::x, &Disk::y, &Disk::r})
+        {
+            for(unsigned long i=0; i<disks.size(); i++)
+            {
+                component[i] = disks[i].*member;
+            }
+            file.write(reinterpret_cast<char const *>(component.data()), component.size()*sizeof(float));
+        }
+    }
+    if(!file.good())
+    {
+        throw example_format_error(filename + " : error while writing");
+    }
+}
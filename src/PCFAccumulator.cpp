@@ -0,0 +1,92 @@
+#include <utility>
+#include "../include/PCFAccumulator.h"
+#include "../include/computeFunctions.h"
+
+PCFAccumulator::PCFAccumulator(std::vector<float> _radii, std::vector<float> _area, float _rmax, float _sigma, float _diskfactor, bool _same, float _period) :
+    radii(std::move(_radii)), area(std::move(_area)), rmax(_rmax), sigma(_sigma), diskfactor(_diskfactor), period(_period), same(_same){
+    sums.resize(radii.size(), 0);
+}
+
+void PCFAccumulator::reset(){
+    disks_a.clear();
+    disks_b.clear();
+    weights_a.clear();
+    std::fill(sums.begin(), sums.end(), 0);
+}
+
+void PCFAccumulator::addPairs(Disk const & pi, float const * weight_i, Disk const & pj, float const * weight_j){
+    float d = euclidian(pi, pj, period);
+    for(unsigned long k=0; k<radii.size(); k++)
+    {
+        float g = gaussian_kernel(sigma, (radii[k]-d)/rmax);
+        sums[k]+= (weight_j == nullptr ? weight_i[k] : weight_i[k]+weight_j[k])*g;
+    }
+}
+
+bool PCFAccumulator::add(std::vector<Disk> const & new_a, std::vector<Disk> const & new_b){
+    const unsigned long nSteps = radii.size();
+    unsigned long old_a = disks_a.size();
+    for(auto const & d : new_a)
+    {
+        auto weight = get_weight(d, radii, diskfactor, period > 0);
+        for(auto & w : weight)
+        {
+            w = w > 4 ? 4 : w;
+        }
+        weights_a.insert(weights_a.end(), weight.begin(), weight.end());
+        disks_a.push_back(d);
+    }
+    if(same)
+    {
+        //Every pair (i, j) with i != j is added when the last of the two disks is added
+        for(unsigned long i=old_a; i<disks_a.size(); i++)
+        {
+            for(unsigned long j=0; j<i; j++)
+            {
+                addPairs(disks_a[i], &weights_a[i*nSteps], disks_a[j], &weights_a[j*nSteps]);
+            }
+        }
+        return !new_a.empty();
+    }
+    //New disks of a against the disks of b we already had
+    for(unsigned long i=old_a; i<disks_a.size(); i++)
+    {
+        for(auto const & pj : disks_b)
+        {
+            addPairs(disks_a[i], &weights_a[i*nSteps], pj, nullptr);
+        }
+    }
+    //Then all the disks of a against the new disks of b
+    for(auto const & pj : new_b)
+    {
+        for(unsigned long i=0; i<disks_a.size(); i++)
+        {
+            addPairs(disks_a[i], &weights_a[i*nSteps], pj, nullptr);
+        }
+        disks_b.push_back(pj);
+    }
+    return !new_a.empty() || !new_b.empty();
+}
+
+std::vector<float> PCFAccumulator::getPCF() const{
+    std::vector<float> pcf;
+    pcf.resize(radii.size(), 0);
+    const std::vector<Disk> & b = same ? disks_a : disks_b;
+    if(disks_a.empty() || b.empty())
+    {
+        return pcf;
+    }
+    for(unsigned long k=0; k<pcf.size(); k++)
+    {
+        pcf[k] = float(sums[k]/(double(area[k])*disks_a.size()*b.size()));
+    }
+    return pcf;
+}
+
+std::vector<float> const & PCFAccumulator::getRadii() const{
+    return radii;
+}
+
+float PCFAccumulator::getRmax() const{
+    return rmax;
+}
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include "../include/SpatialDisks.h"
+
+/**
+ * Spreads the 16 low bits of v on the even bits
+ */
+static uint32_t spreadBits(uint32_t v){
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+uint32_t SpatialDisks::morton(Disk const & d) const{
+    auto quantize = [this](float v){
+        return (uint32_t)clip(v/domainLength*65536.f, 0.f, 65535.f);
+    };
+    return spreadBits(quantize(d.x)) | (spreadBits(quantize(d.y)) << 1);
+}
+
+bool SpatialDisks::needsSort(unsigned long count) const{
+    return count - sorted > std::max<unsigned long>(BLOCK_SIZE, (unsigned long)(sorted*RESORT_RATIO));
+}
+
+void SpatialDisks::assign(std::vector<Disk> const & _disks, std::vector<std::vector<float>> const & _weights, bool grown){
+    disks = _disks;
+    ids.resize(disks.size());
+    std::iota(ids.begin(), ids.end(), 0ul);
+    weight_rows.clear();
+    weight_rows.reserve(disks.size()*nSteps);
+    for(unsigned long i=0; i<disks.size() && nSteps > 0; i++)
+    {
+        weight_rows.insert(weight_rows.end(), _weights[i].begin(), _weights[i].begin()+nSteps);
+    }
+    sorted = 0;
+    unsigned long count = disks.size();
+    if(grown)
+    {
+        //Replays the sorts of add
+        for(unsigned long n=1; n<=disks.size(); n++)
+        {
+            if(needsSort(n))
+            {
+                sorted = n;
+            }
+        }
+        count = sorted;
+    }
+    sort(count);
+}
+
+void SpatialDisks::add(Disk const & d, std::vector<float> const & _weights){
+    disks.push_back(d);
+    ids.push_back(ids.size());
+    weight_rows.insert(weight_rows.end(), _weights.begin(), _weights.begin()+nSteps);
+    if(needsSort(disks.size()))
+    {
+        sort(disks.size());
+    }else
+    {
+        addToBlock(disks.size()-1);
+    }
+}
+
+void SpatialDisks::sort(unsigned long count){
+    std::vector<std::pair<uint32_t, unsigned long>> order;
+    order.reserve(count);
+    for(unsigned long slot=0; slot<count; slot++)
+    {
+        order.emplace_back(morton(disks[slot]), slot);
+    }
+    //Ties are broken by id, so that the order only depends on the disks and not on the previous sorts
+    std::sort(order.begin(), order.end(), [this](auto const & a, auto const & b){
+        return a.first != b.first ? a.first < b.first : ids[a.second] < ids[b.second];
+    });
+    std::vector<Disk> sorted_disks;
+    std::vector<unsigned long> sorted_ids;
+    std::vector<float> sorted_weights;
+    sorted_disks.reserve(disks.size());
+    sorted_ids.reserve(disks.size());
+    sorted_weights.reserve(weight_rows.size());
+    for(auto const & o : order)
+    {
+        sorted_disks.push_back(disks[o.second]);
+        sorted_ids.push_back(ids[o.second]);
+        sorted_weights.insert(sorted_weights.end(), weight_rows.begin()+o.second*nSteps, weight_rows.begin()+(o.second+1)*nSteps);
+    }
+    sorted_disks.insert(sorted_disks.end(), disks.begin()+count, disks.end());
+    sorted_ids.insert(sorted_ids.end(), ids.begin()+count, ids.end());
+    sorted_weights.insert(sorted_weights.end(), weight_rows.begin()+count*nSteps, weight_rows.end());
+    disks = std::move(sorted_disks);
+    ids = std::move(sorted_ids);
+    weight_rows = std::move(sorted_weights);
+    sorted = count;
+
+    blocks.clear();
+    for(unsigned long slot=0; slot<disks.size(); slot++)
+    {
+        addToBlock(slot);
+    }
+}
+
+void SpatialDisks::addToBlock(unsigned long slot){
+    auto const & d = disks[slot];
+    if(slot % BLOCK_SIZE == 0)
+    {
+        blocks.push_back({d.x, d.y, d.x, d.y, d.r});
+        return;
+    }
+    auto & block = blocks.back();
+    block.min_x = std::min(block.min_x, d.x);
+    block.min_y = std::min(block.min_y, d.y);
+    block.max_x = std::max(block.max_x, d.x);
+    block.max_y = std::max(block.max_y, d.y);
+    block.max_r = std::max(block.max_r, d.r);
+}
+
+bool SpatialDisks::isFar(unsigned long b, float x, float y, float distance, float period) const{
+    auto const & block = blocks[b];
+    //Distance from the coordinate to the interval of the block, the shortest way around if periodic
+    auto gap = [period](float v, float min, float max){
+        if(v >= min && v <= max)
+        {
+            return 0.f;
+        }
+        float direct = v < min ? min - v : v - max;
+        if(period > 0)
+        {
+            float around = v < min ? v + period - max : min + period - v;
+            return std::max(0.f, std::min(direct, around));
+        }
+        return direct;
+    };
+    float dx = gap(x, block.min_x, block.max_x);
+    float dy = gap(y, block.min_y, block.max_y);
+    float reach = distance + block.max_r;
+    return dx*dx + dy*dy > reach*reach;
+}
@@ -0,0 +1,99 @@
+#include <string>
+#include "../include/Stats.h"
+
+ScopedTimer::~ScopedTimer(){
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    if(access)
+    {
+        std::lock_guard<std::mutex> lock(*access);
+        total += seconds;
+    }else
+    {
+        total += seconds;
+    }
+}
+
+void Category_stats::addFailStreak(unsigned long fails){
+    unsigned long bucket = 0;
+    while(fails > 0 && bucket < STREAK_BUCKETS-1)
+    {
+        fails >>= 1u;
+        bucket++;
+    }
+    fail_streaks[bucket]++;
+}
+
+double Category_stats::averageError() const{
+    return darts_thrown == 0 ? 0 : e_sum/darts_thrown;
+}
+
+double Category_stats::dartsPerAccept() const{
+    return darts_accepted == 0 ? 0 : double(darts_thrown)/darts_accepted;
+}
+
+Category_stats & Category_stats::operator+=(Category_stats const & other){
+    initialize_seconds += other.initialize_seconds;
+    grid_search_seconds += other.grid_search_seconds;
+    final_pcf_seconds += other.final_pcf_seconds;
+    darts_thrown += other.darts_thrown;
+    darts_accepted += other.darts_accepted;
+    darts_rejected += other.darts_rejected;
+    grid_search_entries += other.grid_search_entries;
+    grid_search_exits += other.grid_search_exits;
+    grid_search_accepted += other.grid_search_accepted;
+    grid_search_evaluations += other.grid_search_evaluations;
+    e_sum += other.e_sum;
+    for(unsigned long k=0; k<STREAK_BUCKETS; k++)
+    {
+        fail_streaks[k] += other.fail_streaks[k];
+    }
+    return *this;
+}
+
+void write_stats_json(std::ostream & out, ASMCDD_stats const & stats, unsigned int indent){
+    std::string pad(indent, ' ');
+    out << "{\n"
+        << pad << "  \"target_seconds\": " << stats.target_seconds << ",\n"
+        << pad << "  \"initialize_seconds\": " << stats.initialize_seconds << ",\n"
+        << pad << "  \"refine_seconds\": " << stats.refine_seconds << ",\n"
+        << pad << "  \"classes\": [";
+    for(unsigned long c=0; c<stats.categories.size(); c++)
+    {
+        auto const & s = stats.categories[c];
+        out << (c == 0 ? "\n" : ",\n")
+            << pad << "    {\n"
+            << pad << "      \"id\": " << c << ",\n"
+            << pad << "      \"initialize_seconds\": " << s.initialize_seconds << ",\n"
+            << pad << "      \"grid_search_seconds\": " << s.grid_search_seconds << ",\n"
+            << pad << "      \"final_pcf_seconds\": " << s.final_pcf_seconds << ",\n"
+            << pad << "      \"darts_thrown\": " << s.darts_thrown << ",\n"
+            << pad << "      \"darts_accepted\": " << s.darts_accepted << ",\n"
+            << pad << "      \"darts_rejected\": " << s.darts_rejected << ",\n"
+            << pad << "      \"grid_search_entries\": " << s.grid_search_entries << ",\n"
+            << pad << "      \"grid_search_exits\": " << s.grid_search_exits << ",\n"
+            << pad << "      \"grid_search_accepted\": " << s.grid_search_accepted << ",\n"
+            << pad << "      \"grid_search_evaluations\": " << s.grid_search_evaluations << ",\n"
+            << pad << "      \"tolerance_schedule\": \"" << tolerance_schedule_name(s.tolerance_schedule) << "\",\n"
+            << pad << "      \"darts_per_accept\": " << s.dartsPerAccept() << ",\n"
+            << pad << "      \"average_e\": " << s.averageError() << ",\n"
+            << pad << "      \"fail_streaks\": [";
+        bool first = true;
+        for(unsigned long k=0; k<Category_stats::STREAK_BUCKETS; k++)
+        {
+            if(s.fail_streaks[k] == 0)
+            {
+                continue;
+            }
+            unsigned long from = k == 0 ? 0 : 1ul << (k-1);
+            out << (first ? "" : ", ") << "{\"from\": " << from << ", ";
+            if(k+1 < Category_stats::STREAK_BUCKETS)
+            {
+                out << "\"to\": " << (k == 0 ? 0 : (1ul << k)-1) << ", ";
+            }
+            out << "\"count\": " << s.fail_streaks[k] << "}";
+            first = false;
+        }
+        out << "]\n" << pad << "    }";
+    }
+    out << (stats.categories.empty() ? "" : "\n" + pad + "  ") << "]\n" << pad << "}";
+}
@@ -0,0 +1,187 @@
+#include "../include/ThreadPool.h"
+#include "../include/Trace.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//Pool and queue of the current thread, if it is a worker
+static thread_local ThreadPool const * current_pool = nullptr;
+static thread_local unsigned int current_queue = 0;
+
+TaskGroup::~TaskGroup(){
+    waitAll();
+}
+
+void TaskGroup::run(std::function<void()> task){
+    pending++;
+    pool.push({std::move(task), this});
+}
+
+void TaskGroup::waitAll(){
+    while(pending.load() > 0)
+    {
+        if(!pool.runOne(this))
+        {
+            //The remaining tasks run on other threads
+            std::unique_lock<std::mutex> lock(pool.sleep_access);
+            pool.wake.wait(lock, [this](){ return pending.load() == 0 || queued.load() > 0; });
+        }
+    }
+}
+
+void TaskGroup::wait(){
+    waitAll();
+    std::lock_guard<std::mutex> lock(error_access);
+    if(error)
+    {
+        auto thrown = error;
+        error = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
+
+ThreadPool::ThreadPool(unsigned int threads, bool pin) : pinned(pin){
+#ifdef __linux__
+    cpu_set_t available;
+    CPU_ZERO(&available);
+    bool has_affinity = sched_getaffinity(0, sizeof(available), &available) == 0;
+    unsigned int cores = has_affinity ? CPU_COUNT(&available) : std::thread::hardware_concurrency();
+#else
+    unsigned int cores = std::thread::hardware_concurrency();
+#endif
+    n_threads = threads > 0 ? threads : std::max(1u, cores);
+    queues.reserve(n_threads);
+    for(unsigned int i=0; i<n_threads; i++)
+    {
+        queues.emplace_back(new Task_queue());
+    }
+    workers.reserve(n_threads-1);
+    for(unsigned int i=1; i<n_threads; i++)
+    {
+        workers.emplace_back(&ThreadPool::work, this, i);
+#ifdef __linux__
+        if(pin && has_affinity)
+        {
+            //Worker i runs on the i-th core the process is allowed on, so that jobs restricted to different cores stay apart
+            unsigned int skip = i % CPU_COUNT(&available);
+            for(int cpu=0; cpu<CPU_SETSIZE; cpu++)
+            {
+                if(CPU_ISSET(cpu, &available) && skip-- == 0)
+                {
+                    cpu_set_t one;
+                    CPU_ZERO(&one);
+                    CPU_SET(cpu, &one);
+                    pthread_setaffinity_np(workers.back().native_handle(), sizeof(one), &one);
+                    break;
+                }
+            }
+        }
+#endif
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(sleep_access);
+        stop = true;
+    }
+    wake.notify_all();
+    for(auto & worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::push(Task task){
+    TaskGroup * task_group = task.group;
+    unsigned int index = current_pool == this ? current_queue : 0;
+    {
+        //Counted before it is queued, so that the counters never go below 0 when it is taken right away
+        std::lock_guard<std::mutex> lock(sleep_access);
+        queued++;
+        task_group->queued++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->access);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    wake.notify_all();
+}
+
+bool ThreadPool::runOne(TaskGroup * group){
+    unsigned int own = current_pool == this ? current_queue : 0;
+    auto matches = [group](Task const & task){ return !group || task.group == group; };
+    for(unsigned int k=0; k<queues.size(); k++)
+    {
+        unsigned int index = (own+k) % queues.size();
+        auto & queue = *queues[index];
+        std::unique_lock<std::mutex> lock(queue.access);
+        if(queue.tasks.empty())
+        {
+            continue;
+        }
+        //Newest task of its own queue, oldest task of the others
+        auto found = queue.tasks.end();
+        if(k == 0)
+        {
+            auto reverse = std::find_if(queue.tasks.rbegin(), queue.tasks.rend(), matches);
+            if(reverse != queue.tasks.rend())
+            {
+                found = std::prev(reverse.base());
+            }
+        }else
+        {
+            found = std::find_if(queue.tasks.begin(), queue.tasks.end(), matches);
+        }
+        if(found == queue.tasks.end())
+        {
+            continue;
+        }
+        Task task = std::move(*found);
+        queue.tasks.erase(found);
+        lock.unlock();
+        queued--;
+        task.group->queued--;
+        execute(task);
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::execute(Task & task){
+    try
+    {
+        task.function();
+    }catch(...)
+    {
+        std::lock_guard<std::mutex> lock(task.group->error_access);
+        if(!task.group->error)
+        {
+            task.group->error = std::current_exception();
+        }
+    }
+    //Released before the group can be destroyed by its waiting thread
+    task.function = nullptr;
+    if(--task.group->pending == 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_access);
+        }
+        wake.notify_all();
+    }
+}
+
+void ThreadPool::work(unsigned int index){
+    TRACE_THREAD_NAME("pool worker");
+    current_pool = this;
+    current_queue = index;
+    while(!stop)
+    {
+        if(!runOne(nullptr))
+        {
+            std::unique_lock<std::mutex> lock(sleep_access);
+            wake.wait(lock, [this](){ return stop.load() || queued.load() > 0; });
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cmath>
+#include "../include/ToleranceSchedule.h"
+
+void ToleranceSchedule::start(){
+    state = Tolerance_state();
+    state.increment = e_delta;
+}
+
+void ToleranceSchedule::rejected(unsigned long fails){
+    switch(schedule.type)
+    {
+        case Tolerance_schedule_type::linear:
+            state.e = e_delta*fails;
+            break;
+        case Tolerance_schedule_type::exponential:
+            state.e += state.increment;
+            state.increment *= schedule.growth;
+            break;
+        case Tolerance_schedule_type::adaptive:
+            state.e = e_delta*state.scale*fails;
+            break;
+        case Tolerance_schedule_type::carry_over:
+            state.e += e_delta;
+            break;
+    }
+}
+
+void ToleranceSchedule::accepted(unsigned long fails){
+    switch(schedule.type)
+    {
+        case Tolerance_schedule_type::linear:
+            state.e = 0;
+            break;
+        case Tolerance_schedule_type::exponential:
+            state.e = 0;
+            state.increment = e_delta;
+            break;
+        case Tolerance_schedule_type::adaptive:
+        {
+            //Longer streaks than wanted make e grow faster, shorter ones slower. Damped so that one streak does not dominate
+            float ratio = (fails+1)*schedule.target_acceptance;
+            state.scale = std::min(std::max(state.scale*std::min(std::max(std::sqrt(ratio), 0.5f), 2.f), 1e-3f), 1e3f);
+            state.e = 0;
+            break;
+        }
+        case Tolerance_schedule_type::carry_over:
+            state.e *= schedule.carry;
+            break;
+    }
+}
+
+const char* tolerance_schedule_name(Tolerance_schedule_type type){
+    switch(type)
+    {
+        case Tolerance_schedule_type::linear:
+            return "linear";
+        case Tolerance_schedule_type::exponential:
+            return "exponential";
+        case Tolerance_schedule_type::adaptive:
+            return "adaptive";
+        case Tolerance_schedule_type::carry_over:
+            return "carry_over";
+    }
+    return "unknown";
+}
+
+bool parse_tolerance_schedule(std::string const & name, Tolerance_schedule_type & type){
+    for(auto t : {Tolerance_schedule_type::linear, Tolerance_schedule_type::exponential, Tolerance_schedule_type::adaptive, Tolerance_schedule_type::carry_over})
+    {
+        if(name == tolerance_schedule_name(t))
+        {
+            type = t;
+            return true;
+        }
+    }
+    return false;
+}
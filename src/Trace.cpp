@@ -0,0 +1,118 @@
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include "../include/Trace.h"
+
+namespace{
+
+struct TraceEvent{
+    char const * name;
+    long arg;
+    double start; // Microseconds since the start of the trace
+    double duration;
+};
+
+/**
+ * Events of a thread, kept alive by the registry after the thread exits
+ */
+struct ThreadBuffer{
+    unsigned long tid;
+    std::string name;
+    std::vector<TraceEvent> events;
+    std::mutex access; // Only contended while the trace is saved
+};
+
+struct TraceRegistry{
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    std::mutex access;
+};
+
+TraceRegistry & registry(){
+    static TraceRegistry instance;
+    return instance;
+}
+
+ThreadBuffer & thread_buffer(){
+    thread_local std::shared_ptr<ThreadBuffer> buffer = [](){
+        auto & reg = registry();
+        auto created = std::make_shared<ThreadBuffer>();
+        created->events.reserve(1024);
+        std::lock_guard<std::mutex> lock(reg.access);
+        created->tid = reg.buffers.size()+1;
+        reg.buffers.push_back(created);
+        return created;
+    }();
+    return *buffer;
+}
+
+void write_escaped(std::ostream & out, std::string const & text){
+    for(char c : text)
+    {
+        if(c == '"' || c == '\\')
+        {
+            out << '\\';
+        }
+        out << c;
+    }
+}
+
+}
+
+TraceScope::~TraceScope(){
+    auto end = std::chrono::steady_clock::now();
+    auto origin = registry().origin;
+    auto & buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(buffer.access);
+    buffer.events.push_back({name, arg, std::chrono::duration<double, std::micro>(start-origin).count(), std::chrono::duration<double, std::micro>(end-start).count()});
+}
+
+void trace_thread_name(std::string const & name){
+    auto & buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(buffer.access);
+    buffer.name = name;
+}
+
+bool trace_save(std::string const & filename){
+    std::ofstream file(filename);
+    if(!file)
+    {
+        return false;
+    }
+    auto & reg = registry();
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(reg.access);
+        buffers = reg.buffers;
+    }
+    file << std::fixed;
+    file.precision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for(auto & buffer : buffers)
+    {
+        std::lock_guard<std::mutex> lock(buffer->access);
+        if(!buffer->name.empty())
+        {
+            file << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"name\":\"";
+            write_escaped(file, buffer->name);
+            file << "\"}}";
+            first = false;
+        }
+        for(auto const & e : buffer->events)
+        {
+            file << (first ? "\n" : ",\n") << "{\"ph\":\"X\",\"name\":\"";
+            write_escaped(file, e.name);
+            file << "\",\"pid\":1,\"tid\":" << buffer->tid << ",\"ts\":" << e.start << ",\"dur\":" << e.duration;
+            if(e.arg >= 0)
+            {
+                file << ",\"args\":{\"id\":" << e.arg << "}";
+            }
+            file << "}";
+            first = false;
+        }
+    }
+    file << "\n]}\n";
+    return bool(file);
+}
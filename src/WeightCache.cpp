@@ -0,0 +1,48 @@
+#include "../include/WeightCache.h"
+#include "../include/computeFunctions.h"
+
+std::shared_ptr<WeightCache::Entry> WeightCache::find(unsigned long category, unsigned long generation, std::vector<Disk> const & disks, std::vector<float> const & radii, float domainLength, bool periodic){
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(access);
+        Key key(category, radii, domainLength, periodic);
+        auto found = entries.find(key);
+        //The disks were replaced since, or were still being added to
+        if(found == entries.end() || found->second->generation != generation || found->second->size != disks.size())
+        {
+            for(auto it = entries.begin(); it != entries.end();)
+            {
+                bool outdated = std::get<0>(it->first) == category && (it->second->generation != generation || it->second->size != disks.size());
+                it = outdated ? entries.erase(it) : std::next(it);
+            }
+            found = entries.emplace(key, std::make_shared<Entry>()).first;
+            found->second->generation = generation;
+            found->second->size = disks.size();
+        }
+        entry = found->second;
+    }
+    //Computed outside of the lock, the other classes asking for it wait for it
+    std::call_once(entry->computed, [&](){
+        entry->weights = std::make_shared<const Weights>(get_weights(disks, radii, 1/domainLength, periodic));
+    });
+    return entry;
+}
+
+std::shared_ptr<const WeightCache::Weights> WeightCache::get(unsigned long category, unsigned long generation, std::vector<Disk> const & disks, std::vector<float> const & radii, float domainLength, bool periodic){
+    return find(category, generation, disks, radii, domainLength, periodic)->weights;
+}
+
+std::shared_ptr<const SpatialDisks> WeightCache::getSorted(unsigned long category, unsigned long generation, std::vector<Disk> const & disks, std::vector<float> const & radii, float domainLength, bool periodic){
+    auto entry = find(category, generation, disks, radii, domainLength, periodic);
+    std::call_once(entry->sorted_once, [&](){
+        auto sorted = std::make_shared<SpatialDisks>(domainLength, radii.size());
+        sorted->assign(disks, *entry->weights);
+        entry->sorted = std::move(sorted);
+    });
+    return entry->sorted;
+}
+
+void WeightCache::clear(){
+    std::lock_guard<std::mutex> lock(access);
+    entries.clear();
+}
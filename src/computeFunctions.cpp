@@ -3,17 +3,32 @@
 //
 
 
+#include <algorithm>
+#include <cmath>
 #include "../include/computeFunctions.h"
+#include "../include/Trace.h"
 
-std::vector<float> compute_density(Disk const & pi, std::vector<Disk> const & others, std::vector<float> const & areas, std::vector<float> const & radii, float rmax, ASMCDD_params const & params, unsigned long same_category_index, unsigned long target_size)
+constexpr float KERNEL_ZERO = 120; // exp(-x) is 0 in float past about 104, with a margin for the rounding of the distances
+
+/**
+ * Distance from a disk beyond which the kernel is 0 at every radius, to the edge of the other disks
+ * Once the disks do not overlap, diskDistance is 2d - 2(r1+r2) + 3 in rmax units, d being the distance between the centers
+ */
+static float kernel_reach(Disk const & pi, std::vector<float> const & radii, float rmax, ASMCDD_params const & params)
+{
+    float last = radii.empty() ? 0 : radii.back()/rmax;
+    return rmax*std::max(0.f, (last + params.sigma*std::sqrt(KERNEL_ZERO) - 3)/2) + pi.r;
+}
+
+std::vector<float> compute_density(Disk const & pi, std::vector<Disk> const & others, std::vector<float> const & areas, std::vector<float> const & radii, float rmax, ASMCDD_params const & params, unsigned long same_category_index, unsigned long target_size, float period)
 {
     auto nSteps = (unsigned long)(params.limit/params.step);
     std::vector<float> weights, density;
-    weights.resize(nSteps);
+    weights.resize(nSteps, 1);
     density.resize(nSteps, 0);
     if(others.empty())
         return density;
-    for(unsigned long k=0; k<nSteps; k++)
+    for(unsigned long k=0; k<nSteps && period <= 0; k++)
     {
         float perimeter = perimeter_weight(pi.x, pi.y, radii[k]);
         weights[k] = perimeter <= 0 ? 0.0f : 1.f/perimeter;
@@ -23,7 +38,7 @@ std::vector<float> compute_density(Disk const & pi, std::vector<Disk> const & ot
         if(j == same_category_index)
             continue;
         auto & pj = others[j];
-        float d = diskDistance(pi, pj, rmax);
+        float d = diskDistance(pi, pj, rmax, period);
         for(unsigned long k=0; k<nSteps; k++)
         {
             float r = radii[k]/rmax;
@@ -39,11 +54,49 @@ std::vector<float> compute_density(Disk const & pi, std::vector<Disk> const & ot
 
 
 
-std::vector<float> get_weight(Disk const & d, std::vector<float> const & radii, float diskfactor)
+std::vector<float> compute_density(Disk const & pi, SpatialDisks const & others, std::vector<float> const & areas, std::vector<float> const & radii, float rmax, ASMCDD_params const & params, unsigned long same_category_index, float period)
+{
+    auto nSteps = (unsigned long)(params.limit/params.step);
+    std::vector<float> weights, density;
+    weights.resize(nSteps, 1);
+    density.resize(nSteps, 0);
+    if(others.size() == 0)
+        return density;
+    for(unsigned long k=0; k<nSteps && period <= 0; k++)
+    {
+        float perimeter = perimeter_weight(pi.x, pi.y, radii[k]);
+        weights[k] = perimeter <= 0 ? 0.0f : 1.f/perimeter;
+    }
+    float reach = kernel_reach(pi, radii, rmax, params);
+    for(unsigned long b=0; b<others.blockCount(); b++)
+    {
+        if(others.isFar(b, pi.x, pi.y, reach, period))
+            continue;
+        unsigned long end = std::min(others.size(), (b+1)*SpatialDisks::BLOCK_SIZE);
+        for(unsigned long slot=b*SpatialDisks::BLOCK_SIZE; slot<end; slot++)
+        {
+            if(others.id(slot) == same_category_index)
+                continue;
+            float d = diskDistance(pi, others.disk(slot), rmax, period);
+            for(unsigned long k=0; k<nSteps; k++)
+            {
+                float r = radii[k]/rmax;
+                density[k]+=gaussian_kernel(params.sigma, r-d);
+            }
+        }
+    }
+    for(unsigned long k=0; k<nSteps; k++)
+    {
+        density[k]*=weights[k]/areas[k];
+    }
+    return density;
+}
+
+std::vector<float> get_weight(Disk const & d, std::vector<float> const & radii, float diskfactor, bool periodic)
 {
     std::vector<float> weight;
-    weight.resize(radii.size());
-    for(unsigned long k=0; k<radii.size(); k++)
+    weight.resize(radii.size(), 1);
+    for(unsigned long k=0; k<radii.size() && !periodic; k++)
     {
         float perimeter = perimeter_weight(d.x, d.y, radii[k], diskfactor);
         weight[k] = perimeter <= 0 ? 0.0f : 1.f/perimeter;
@@ -51,25 +104,26 @@ std::vector<float> get_weight(Disk const & d, std::vector<float> const & radii,
     return weight;
 }
 
-std::vector<std::vector<float>> get_weights(std::vector<Disk> const & disks, std::vector<float> const & radii, float diskfactor)
+std::vector<std::vector<float>> get_weights(std::vector<Disk> const & disks, std::vector<float> const & radii, float diskfactor, bool periodic)
 {
     std::vector<std::vector<float>> weights;
     weights.reserve(disks.size());
     for(Disk const & pi : disks)
     {
-        weights.push_back(get_weight(pi, radii, diskfactor));
+        weights.push_back(get_weight(pi, radii, diskfactor, periodic));
     }
     return weights;
 }
 
-Contribution compute_contribution(Disk const & pi, std::vector<Disk> const & others, std::vector<std::vector<float>> other_weights, std::vector<float> const & radii, std::vector<float> const & areas, float rmax, ASMCDD_params const & params, unsigned long same_category_index, unsigned long target_size, float diskfactor)
+Contribution compute_contribution(Disk const & pi, std::vector<Disk> const & others, std::vector<std::vector<float>> const & other_weights, std::vector<float> const & radii, std::vector<float> const & areas, float rmax, ASMCDD_params const & params, unsigned long same_category_index, unsigned long target_size, float diskfactor)
 {
     auto nSteps = (unsigned long)(params.limit/params.step);
     Contribution out;
     out.pcf.resize(nSteps, 0);
     out.contribution.resize(nSteps, 0);
     out.weights.resize(nSteps, 1);
-    for(unsigned long k=0; k<nSteps; k++)
+    float period = params.periodic ? 1/diskfactor : 0;
+    for(unsigned long k=0; k<nSteps && !params.periodic; k++)
     {
         float perimeter = perimeter_weight(pi.x, pi.y, radii[k], diskfactor);
         out.weights[k] = perimeter <= 0 ? 0.0f : 1.f/perimeter;
@@ -81,7 +135,7 @@ Contribution compute_contribution(Disk const & pi, std::vector<Disk> const & oth
         if( j == same_category_index)
             continue;
         auto & pj = others[j];
-        float d = diskDistance(pi, pj, rmax);
+        float d = diskDistance(pi, pj, rmax, period);
         for(unsigned long k=0; k<nSteps; k++)
         {
             float r = radii[k]/rmax;
@@ -103,35 +157,136 @@ Contribution compute_contribution(Disk const & pi, std::vector<Disk> const & oth
     return out;
 }
 
-float compute_error(Contribution const & contribution, std::vector<float> const & currentPCF, std::vector<Target_pcf_type> const & target)
+Contribution compute_contribution(Disk const & pi, SpatialDisks const & others, std::vector<float> const & radii, std::vector<float> const & areas, float rmax, ASMCDD_params const & params, unsigned long same_category_index, unsigned long target_size, float diskfactor)
 {
-    // new_mean
-    float error_mean=0;
-    float error_min=0;
-    float error_max=0;
-    for(unsigned long k=0; k<currentPCF.size(); k++)
+    auto nSteps = (unsigned long)(params.limit/params.step);
+    Contribution out;
+    out.pcf.resize(nSteps, 0);
+    out.contribution.resize(nSteps, 0);
+    out.weights.resize(nSteps, 1);
+    float period = params.periodic ? 1/diskfactor : 0;
+    for(unsigned long k=0; k<nSteps && !params.periodic; k++)
     {
-        error_mean = std::max((currentPCF[k]+contribution.contribution[k] - target[k].mean)/target[k].mean, error_mean);
+        float perimeter = perimeter_weight(pi.x, pi.y, radii[k], diskfactor);
+        out.weights[k] = perimeter <= 0 ? 0.0f : 1.f/perimeter;
     }
-    for(unsigned long k=0; k<currentPCF.size(); k++)
+    if(others.size() == 0)
+        return out;
+    //The kernel is 0 for the skipped blocks, so only the order of the sums changes
+    float reach = kernel_reach(pi, radii, rmax, params);
+    for(unsigned long b=0; b<others.blockCount(); b++)
     {
-        error_max = std::max((contribution.pcf[k] - target[k].max)/target[k].max, error_max);
+        if(others.isFar(b, pi.x, pi.y, reach, period))
+            continue;
+        unsigned long end = std::min(others.size(), (b+1)*SpatialDisks::BLOCK_SIZE);
+        for(unsigned long slot=b*SpatialDisks::BLOCK_SIZE; slot<end; slot++)
+        {
+            if(others.id(slot) == same_category_index)
+                continue;
+            float d = diskDistance(pi, others.disk(slot), rmax, period);
+            float const * other_weights = others.weights(slot);
+            for(unsigned long k=0; k<nSteps; k++)
+            {
+                float r = radii[k]/rmax;
+                float res = gaussian_kernel(params.sigma, r-d);
+                out.pcf[k]+= res;
+                out.contribution[k]+= res*other_weights[k];
+            }
+        }
     }
-    for(unsigned long k=0; k<currentPCF.size(); k++)
+    for(unsigned long k=0; k<nSteps; k++)
     {
-        error_min = std::max((target[k].min - contribution.pcf[k])/target[k].min, error_min);
+        out.pcf[k]*=out.weights[k]/areas[k];
+        out.contribution[k] = out.pcf[k] + out.contribution[k]/areas[k];
+
+        out.pcf[k]/=others.size();
+        out.contribution[k]/=target_size;
+
     }
-    return error_mean+std::max(error_max, error_min);
+
+    return out;
 }
 
-std::vector<Target_pcf_type> compute_pcf(std::vector<Disk> const & disks_a, std::vector<Disk> const & disks_b, std::vector<float> const & area, std::vector<float> const & radii, float rmax, ASMCDD_params const & params){
+Target_pcf_arrays split_target_pcf(std::vector<Target_pcf_type> const & target)
+{
+    Target_pcf_arrays out;
+    for(auto const & t : target)
+    {
+        out.mean.push_back(t.mean);
+        out.min.push_back(t.min);
+        out.max.push_back(t.max);
+        //1/0 is infinite, as a division by 0 in compute_error would be
+        out.inv_mean.push_back(1.0/t.mean);
+        out.inv_min.push_back(1.0/t.min);
+        out.inv_max.push_back(1.0/t.max);
+    }
+    return out;
+}
+
+float compute_error(Contribution const & contribution, std::vector<float> const & currentPCF, Target_pcf_arrays const & target)
+{
+    constexpr unsigned long LANES = 8;
+    unsigned long n = currentPCF.size();
+    float const * current = currentPCF.data();
+    float const * contrib = contribution.contribution.data();
+    float const * pcf = contribution.pcf.data();
+    float const * mean = target.mean.data();
+    float const * min = target.min.data();
+    float const * max = target.max.data();
+    double const * inv_mean = target.inv_mean.data();
+    double const * inv_min = target.inv_min.data();
+    double const * inv_max = target.inv_max.data();
+    auto term_mean = [&](unsigned long k){ return float((current[k]+contrib[k] - mean[k])*inv_mean[k]); };
+    auto term_max = [&](unsigned long k){ return float((pcf[k] - max[k])*inv_max[k]); };
+    auto term_min = [&](unsigned long k){ return float((min[k] - pcf[k])*inv_min[k]); };
+
+    //One maximum per lane so that the pass vectorizes, the NaN terms are only flagged
+    float error_mean[LANES] = {}, error_max[LANES] = {}, error_min[LANES] = {};
+    int nan[LANES] = {};
+    auto fuse = [&](unsigned long lane, unsigned long k){
+        float e_mean = term_mean(k), e_max = term_max(k), e_min = term_min(k);
+        error_mean[lane] = std::max(e_mean, error_mean[lane]);
+        error_max[lane] = std::max(e_max, error_max[lane]);
+        error_min[lane] = std::max(e_min, error_min[lane]);
+        nan[lane] |= (e_mean != e_mean) | (e_max != e_max) | (e_min != e_min);
+    };
+    unsigned long k=0;
+    for(; k+LANES<=n; k+=LANES)
+    {
+        for(unsigned long lane=0; lane<LANES; lane++)
+        {
+            fuse(lane, k+lane);
+        }
+    }
+    for(unsigned long lane=0; k<n; k++, lane++)
+    {
+        fuse(lane, k);
+    }
+    if(std::none_of(nan, nan+LANES, [](int v){ return v != 0; }))
+    {
+        float e_mean = *std::max_element(error_mean, error_mean+LANES);
+        float e_max = *std::max_element(error_max, error_max+LANES);
+        float e_min = *std::max_element(error_min, error_min+LANES);
+        return e_mean+std::max(e_max, e_min);
+    }
+    //A NaN term (a 0 difference with a 0 target) discards the maximum so far, the terms are then reduced in order
+    float e_mean=0, e_max=0, e_min=0;
+    for(k=0; k<n; k++)
+    {
+        e_mean = std::max(term_mean(k), e_mean);
+        e_max = std::max(term_max(k), e_max);
+        e_min = std::max(term_min(k), e_min);
+    }
+    return e_mean+std::max(e_max, e_min);
+}
+
+std::vector<Target_pcf_type> compute_pcf(std::vector<Disk> const & disks_a, std::vector<Disk> const & disks_b, std::vector<float> const & area, std::vector<float> const & radii, float rmax, ASMCDD_params const & params, float domainLength, float period){
+    TRACE_SCOPE("compute_pcf");
     std::vector<Target_pcf_type> out;
     unsigned long nSteps = radii.size();
     out.resize(nSteps, {0,std::numeric_limits<float>::infinity(),-std::numeric_limits<float>::infinity()});
     bool same_category = &disks_a == &disks_b;
-    for(unsigned long i=0; i<disks_a.size(); i++)
-    {
-        auto current = compute_density(disks_a[i], disks_b, area, radii, rmax, params, same_category ? i : disks_b.size(), disks_b.size());
+    auto add_density = [&](std::vector<float> current){
         for(unsigned long k=0; k<nSteps; k++)
         {
             current[k]/=disks_b.size();
@@ -145,6 +300,27 @@ std::vector<Target_pcf_type> compute_pcf(std::vector<Disk> const & disks_a, std:
                 out[k].min = current[k];
             }
         }
+    };
+    if(params.spatial_sort)
+    {
+        SpatialDisks sorted_b(domainLength, 0);
+        sorted_b.assign(disks_b, {});
+        SpatialDisks sorted_a(domainLength, 0);
+        if(!same_category)
+        {
+            sorted_a.assign(disks_a, {});
+        }
+        auto const & a = same_category ? sorted_b : sorted_a;
+        for(unsigned long slot=0; slot<a.size(); slot++)
+        {
+            add_density(compute_density(a.disk(slot), sorted_b, area, radii, rmax, params, same_category ? a.id(slot) : disks_b.size(), period));
+        }
+    }else
+    {
+        for(unsigned long i=0; i<disks_a.size(); i++)
+        {
+            add_density(compute_density(disks_a[i], disks_b, area, radii, rmax, params, same_category ? i : disks_b.size(), disks_b.size(), period));
+        }
     }
     for(unsigned long k=0; k<nSteps; k++)
     {
@@ -154,14 +330,14 @@ std::vector<Target_pcf_type> compute_pcf(std::vector<Disk> const & disks_a, std:
     return out;
 }
 
-std::vector<float> compute_pretty_pcf(std::vector<Disk> const & disks_a, std::vector<Disk> const & disks_b, std::vector<float> const & radii, std::vector<float> const & area, float rmax, ASMCDD_params const & params, float diskfactor)
+std::vector<float> compute_pretty_pcf(std::vector<Disk> const & disks_a, std::vector<Disk> const & disks_b, std::vector<float> const & radii, std::vector<float> const & area, float rmax, ASMCDD_params const & params, float diskfactor, float period)
 {
     std::vector<float> pcf, density;
     pcf.resize(radii.size(), 0);
     density.resize(radii.size());
     for(auto const & pi : disks_a)
     {
-        auto weight = get_weight(pi, radii, diskfactor);
+        auto weight = get_weight(pi, radii, diskfactor, period > 0);
         std::fill(density.begin(), density.end(), 0);
         for(unsigned long k=0; k<radii.size(); k++)
         {
@@ -169,7 +345,7 @@ std::vector<float> compute_pretty_pcf(std::vector<Disk> const & disks_a, std::ve
             {
                 if(&pi != &pj)
                 {
-                    density[k]+=gaussian_kernel(params.sigma, (radii[k]-euclidian(pi, pj))/rmax);
+                    density[k]+=gaussian_kernel(params.sigma, (radii[k]-euclidian(pi, pj, period))/rmax);
                 }
             }
             pcf[k]+=density[k]*(weight[k] > 4 ? 4 : weight[k])/disks_a.size();
@@ -181,3 +357,73 @@ std::vector<float> compute_pretty_pcf(std::vector<Disk> const & disks_a, std::ve
     }
     return pcf;
 }
+
+std::vector<float> sample_radii(std::vector<Disk> const & target, unsigned long long n_repeat, unsigned long count, std::mt19937_64 & rand_gen)
+{
+    //Histogram of the distinct radii, in descending order
+    std::vector<float> values;
+    values.reserve(target.size());
+    for(auto const & d : target)
+    {
+        values.push_back(d.r);
+    }
+    std::sort(values.rbegin(), values.rend());
+    std::vector<unsigned long long> remaining;
+    auto last = values.begin();
+    for(auto it = values.begin(); it != values.end();)
+    {
+        auto next = std::find_if(it, values.end(), [it](float v){ return v != *it; });
+        *last++ = *it;
+        remaining.push_back(n_repeat*(next-it));
+        it = next;
+    }
+    values.erase(last, values.end());
+
+    //Fenwick tree over the remaining amount of each radius, to draw one radius in O(log(distinct radii))
+    const unsigned long n = remaining.size();
+    std::vector<unsigned long long> tree(n+1, 0);
+    unsigned long long total = 0;
+    for(unsigned long i=0; i<n; i++)
+    {
+        total += remaining[i];
+        for(unsigned long j=i+1; j<=n; j+=j&(-j))
+        {
+            tree[j]+=remaining[i];
+        }
+    }
+    unsigned long top_bit = 1;
+    while(top_bit*2 <= n)
+    {
+        top_bit*=2;
+    }
+    std::vector<unsigned long> drawn(n, 0);
+    count = (unsigned long)std::min<unsigned long long>(count, total);
+    for(unsigned long s=0; s<count; s++)
+    {
+        unsigned long long u = std::uniform_int_distribution<unsigned long long>(0, total-1)(rand_gen);
+        //Find the first radius whose cumulated amount exceeds u
+        unsigned long pos = 0;
+        for(unsigned long bit = top_bit; bit > 0; bit/=2)
+        {
+            if(pos+bit <= n && tree[pos+bit] <= u)
+            {
+                pos += bit;
+                u -= tree[pos];
+            }
+        }
+        drawn[pos]++;
+        total--;
+        for(unsigned long j=pos+1; j<=n; j+=j&(-j))
+        {
+            tree[j]--;
+        }
+    }
+
+    std::vector<float> radii;
+    radii.reserve(count);
+    for(unsigned long i=0; i<n; i++)
+    {
+        radii.insert(radii.end(), drawn[i], values[i]);
+    }
+    return radii;
+}
@@ -75,7 +75,7 @@ float perimeter_weight(float x, float y, float r, float diskfact)
     return perimeter_weight(x*diskfact, y*diskfact, r*diskfact);
 }
 
-float diskDistance(Disk const & a, Disk const & b, float rmax)
+float diskDistance(Disk const & a, Disk const & b, float rmax, float period)
 {
     float r1, r2;
     if(a.r > b.r)
@@ -89,7 +89,7 @@ float diskDistance(Disk const & a, Disk const & b, float rmax)
     }
     r1/=rmax;
     r2/=rmax;
-    float d = euclidian(a,b)/rmax;
+    float d = euclidian(a,b,period)/rmax;
     float extent = std::max(d+r1+r2, 2*r1);
     float overlap = clip(r1+r2-d, 0.0f, 2*r2);
     float f = (extent-overlap+d+r1-r2);